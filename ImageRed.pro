@@ -39,16 +39,36 @@ SOURCES += \
         mainwindow.cpp \
     inputmatrix.cpp \
     imageproc.cpp \
-    histogram.cpp
+    opgraph.cpp \
+    histogram.cpp \
+    pointops.cpp \
+    tonelut.cpp \
+    convolve.cpp \
+    fft.cpp \
+    svd.cpp \
+    border.cpp \
+    planar.cpp \
+    progress.cpp \
+    threadpool.cpp
 
 HEADERS += \
         mainwindow.h \
-    mycoloriterator.h \
+    imageview.h \
     matrix.h \
     inputmatrix.h \
     imageproc.h \
+    opgraph.h \
     histogram.h \
-    timer.h
+    timer.h \
+    pointops.h \
+    tonelut.h \
+    convolve.h \
+    fft.h \
+    svd.h \
+    border.h \
+    planar.h \
+    progress.h \
+    threadpool.h
 
 FORMS += \
         mainwindow.ui
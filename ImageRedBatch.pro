@@ -0,0 +1,50 @@
+#-------------------------------------------------
+#
+# Headless batch processor: same ImageProc, no widgets
+#
+#-------------------------------------------------
+
+QT       += core gui
+QT       -= widgets
+
+TARGET = ImageRedBatch
+TEMPLATE = app
+
+CONFIG += console c++14
+CONFIG -= app_bundle
+
+QMAKE_CXXFLAGS += -std=c++14
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+SOURCES += \
+    batch.cpp \
+    opchain.cpp \
+    imageproc.cpp \
+    opgraph.cpp \
+    pointops.cpp \
+    tonelut.cpp \
+    convolve.cpp \
+    fft.cpp \
+    svd.cpp \
+    border.cpp \
+    planar.cpp \
+    progress.cpp \
+    threadpool.cpp
+
+HEADERS += \
+    opchain.h \
+    imageproc.h \
+    opgraph.h \
+    imageview.h \
+    matrix.h \
+    timer.h \
+    pointops.h \
+    tonelut.h \
+    convolve.h \
+    fft.h \
+    svd.h \
+    border.h \
+    planar.h \
+    progress.h \
+    threadpool.h
@@ -0,0 +1,59 @@
+#-------------------------------------------------
+#
+# Benchmarks for ImageProc (Google Benchmark)
+#
+#-------------------------------------------------
+
+QT       += core gui
+QT       -= widgets
+
+TARGET = ImageRedBench
+TEMPLATE = app
+
+CONFIG += console c++14
+CONFIG -= app_bundle
+
+QMAKE_CXXFLAGS += -std=c++14
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+# путь к установленной Google Benchmark, если она не в системных каталогах:
+# qmake BENCHMARK_DIR=/opt/benchmark
+!isEmpty(BENCHMARK_DIR) {
+    INCLUDEPATH += $$BENCHMARK_DIR/include
+    LIBS += -L$$BENCHMARK_DIR/lib
+}
+
+LIBS += -lbenchmark
+unix: LIBS += -lpthread
+win32: LIBS += -lshlwapi
+
+SOURCES += \
+    bench.cpp \
+    imageproc.cpp \
+    opgraph.cpp \
+    pointops.cpp \
+    tonelut.cpp \
+    convolve.cpp \
+    fft.cpp \
+    svd.cpp \
+    border.cpp \
+    planar.cpp \
+    progress.cpp \
+    threadpool.cpp
+
+HEADERS += \
+    imageproc.h \
+    opgraph.h \
+    imageview.h \
+    matrix.h \
+    timer.h \
+    pointops.h \
+    tonelut.h \
+    convolve.h \
+    fft.h \
+    svd.h \
+    border.h \
+    planar.h \
+    progress.h \
+    threadpool.h
@@ -0,0 +1,296 @@
+//  ImageRedBatch - пакетная обработка без окон (для серверов без X).
+//
+//  ImageRedBatch -o <каталог> -p "gray-world,median:5,gauss" [-j N] файлы-или-каталоги...
+//
+//  Конвейер из трёх стадий: чтение, обработка, запись. Стадии связаны очередями ограниченной
+//  длины, так что пока одни файлы декодируются или кодируются, другие уже обрабатываются,
+//  а в памяти одновременно держится лишь несколько изображений.
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QImage>
+#include <QImageReader>
+#include <QSet>
+#include <QTextStream>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "imageproc.h"
+#include "opchain.h"
+#include "threadpool.h"
+
+namespace {
+
+// очередь между стадиями; Push ждёт, пока есть место, Pop - пока есть элемент или очередь закрыта
+template<typename T>
+class StageQueue
+{
+public:
+    explicit StageQueue(const size_t capacity) : capacity(capacity) {}
+
+    void Push(T item)
+    {
+        unique_lock<mutex> lock(m);
+        not_full.wait(lock, [this]{ return items.size() < capacity; });
+        items.push_back(move(item));
+        not_empty.notify_one();
+    }
+
+    bool Pop(T& item)
+    {
+        unique_lock<mutex> lock(m);
+        not_empty.wait(lock, [this]{ return !items.empty() || closed; });
+
+        if (items.empty())
+            return false;
+
+        item = move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    void Close()
+    {
+        lock_guard<mutex> lock(m);
+        closed = true;
+        not_empty.notify_all();
+    }
+
+private:
+    const size_t capacity;
+    deque<T> items;
+    bool closed = false;
+    mutex m;
+    condition_variable not_full;
+    condition_variable not_empty;
+};
+
+struct Item
+{
+    int index;
+    QImage img;
+};
+
+struct Batch
+{
+    QStringList inputs;
+    QStringList outputs;
+    QByteArray format;          // пустой - как у исходного файла
+    int quality = -1;
+
+    atomic<int> done{ 0 };
+    atomic<int> failed{ 0 };
+    mutex log_mutex;
+};
+
+void Log(Batch& b, const QString& msg, const bool error = false)
+{
+    lock_guard<mutex> lock(b.log_mutex);
+
+    static QTextStream out(stdout);
+    static QTextStream err(stderr);
+
+    QTextStream& s = error ? err : out;
+    // endl у QTextStream устарел (Qt 5.14), поэтому перевод строки и flush отдельно
+    s << msg << '\n';
+    s.flush();
+}
+
+void Fail(Batch& b, const int index, const QString& what)
+{
+    ++b.failed;
+    Log(b, QString("%1: %2").arg(b.inputs[index], what), true);
+}
+
+// файлы каталога с расширениями, которые умеет читать QImageReader, по алфавиту
+QStringList ImagesInDir(const QString& dir)
+{
+    QStringList filters;
+    for (const QByteArray& fmt : QImageReader::supportedImageFormats())
+        filters << "*." + QString::fromLatin1(fmt);
+
+    QStringList result;
+    for (const QFileInfo& fi : QDir(dir).entryInfoList(filters, QDir::Files | QDir::Readable, QDir::Name))
+        result << fi.absoluteFilePath();
+
+    return result;
+}
+
+// count потоков выполняют func; когда закончили все, on_finish закрывает очередь следующей стадии
+template<typename F>
+void RunStage(const unsigned count, F func, std::function<void()> on_finish)
+{
+    vector<thread> threads;
+    for (unsigned i = 0; i < count; ++i)
+        threads.emplace_back(func);
+
+    for (auto& t : threads)
+        t.join();
+
+    on_finish();
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("ImageRedBatch");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Пакетная обработка изображений.\n\n" + OpChainHelp());
+    parser.addHelpOption();
+
+    QCommandLineOption ops_opt({ "p", "ops" }, "Цепочка операций через запятую.", "цепочка");
+    QCommandLineOption out_opt({ "o", "output" }, "Каталог для результатов.", "каталог");
+    QCommandLineOption jobs_opt({ "j", "jobs" }, "Сколько изображений обрабатывать одновременно (по умолчанию 2).", "N", "2");
+    QCommandLineOption format_opt({ "f", "format" }, "Формат результата (png, jpg, ...), по умолчанию как у исходного.", "формат");
+    QCommandLineOption quality_opt({ "q", "quality" }, "Качество сжатия 0..100.", "q", "-1");
+
+    parser.addOptions({ ops_opt, out_opt, jobs_opt, format_opt, quality_opt });
+    parser.addPositionalArgument("входы", "Файлы изображений или каталоги с ними.");
+    parser.process(app);
+
+    QTextStream err(stderr);
+
+    OpChain chain;
+    QString error;
+    if (!parser.isSet(ops_opt) || !ParseOpChain(parser.value(ops_opt), &chain, &error))
+    {
+        err << (parser.isSet(ops_opt) ? error : QString("не задана цепочка операций (-p)")) << '\n';
+        return 2;
+    }
+
+    if (!parser.isSet(out_opt) || !QDir().mkpath(parser.value(out_opt)))
+    {
+        err << "не задан или не создаётся каталог для результатов (-o)" << '\n';
+        return 2;
+    }
+
+    bool ok = false;
+    const int jobs = parser.value(jobs_opt).toInt(&ok);
+    if (!ok || jobs < 1)
+    {
+        err << "неверное значение -j" << '\n';
+        return 2;
+    }
+
+    Batch batch;
+    batch.format = parser.value(format_opt).toLatin1();
+    batch.quality = parser.value(quality_opt).toInt();
+
+    for (const QString& arg : parser.positionalArguments())
+    {
+        if (QFileInfo(arg).isDir())
+            batch.inputs << ImagesInDir(arg);
+        else
+            batch.inputs << arg;
+    }
+
+    if (batch.inputs.isEmpty())
+    {
+        err << "нет входных файлов" << '\n';
+        return 2;
+    }
+
+    // входы из разных каталогов с одинаковым именем (a/img.jpg и b/img.png с -f png) записались бы
+    // в один файл: повторные имена получают номер - img_2.png, img_3.png, ...
+    const QDir out_dir(parser.value(out_opt));
+    QSet<QString> used;
+    for (const QString& in : batch.inputs)
+    {
+        const QFileInfo fi(in);
+        const QString suffix = batch.format.isEmpty() ? fi.suffix() : QString::fromLatin1(batch.format);
+
+        const QString plain = fi.completeBaseName() + "." + suffix;
+        QString name = plain;
+        for (int n = 2; used.contains(name.toLower()); ++n)
+            name = QString("%1_%2.%3").arg(fi.completeBaseName()).arg(n).arg(suffix);
+
+        if (name != plain)
+            err << in << ": " << plain << " уже занято, результат - " << name << '\n';
+
+        used.insert(name.toLower());
+        batch.outputs << out_dir.filePath(name);
+    }
+
+    err.flush();
+
+    // чтение и запись однопоточные внутри кодеков, поэтому их потоков больше;
+    // обработка сама распараллелена через пул
+    const unsigned io_threads = max(1u, ThreadPool::Instance().Size() / 2);
+    const size_t depth = 2 * static_cast<size_t>(jobs);
+
+    StageQueue<Item> decoded(depth);
+    StageQueue<Item> processed(depth);
+    atomic<int> next{ 0 };
+
+    QElapsedTimer timer;
+    timer.start();
+
+    thread reader([&]{
+        RunStage(io_threads, [&]{
+            for (int i = next++; i < batch.inputs.size(); i = next++)
+            {
+                QImage img;
+                if (!img.load(batch.inputs[i]))
+                {
+                    Fail(batch, i, "не удалось прочитать");
+                    continue;
+                }
+
+                decoded.Push(Item{ i, img.convertToFormat(QImage::Format_RGB32) });
+            }
+        }, [&]{ decoded.Close(); });
+    });
+
+    thread worker([&]{
+        RunStage(static_cast<unsigned>(jobs), [&]{
+            ImageProc proc;
+            Item item;
+
+            while (decoded.Pop(item))
+            {
+                RunOpChain(chain, proc, &item.img);
+                processed.Push(move(item));
+            }
+        }, [&]{ processed.Close(); });
+    });
+
+    RunStage(io_threads, [&]{
+        Item item;
+
+        while (processed.Pop(item))
+        {
+            const QString& out = batch.outputs[item.index];
+            const char* fmt = batch.format.isEmpty() ? nullptr : batch.format.constData();
+
+            if (!item.img.save(out, fmt, batch.quality))
+            {
+                Fail(batch, item.index, "не удалось записать " + out);
+                continue;
+            }
+
+            const int n = ++batch.done;
+            Log(batch, QString("[%1/%2] %3").arg(n).arg(batch.inputs.size()).arg(out));
+        }
+    }, []{});
+
+    reader.join();
+    worker.join();
+
+    const double secs = timer.elapsed() / 1000.0;
+    Log(batch, QString("Готово: %1 из %2 за %3 с").arg(batch.done.load()).arg(batch.inputs.size()).arg(secs, 0, 'f', 1));
+
+    return batch.failed.load() == 0 ? 0 : 1;
+}
@@ -0,0 +1,236 @@
+//  ImageRedBench - замеры всех операций ImageProc на синтетических изображениях 0.3 - 50 Мпикс.
+//
+//  Результат - счётчик Mpix/s. Параметр threads: 1 - всё в одном потоке, 0 - весь пул;
+//  параметр simd у поточечных операций: 0 - скалярная реализация, 1 - SSE2, 2 - AVX2
+//  (уровень выше поддерживаемого процессором понижается до доступного).
+//  Фильтр по имени: ImageRedBench --benchmark_filter=Median
+
+#include <benchmark/benchmark.h>
+
+#include <QImage>
+
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <utility>
+
+#include "imageproc.h"
+#include "pointops.h"
+#include "threadpool.h"
+
+namespace {
+
+// шум поверх градиентов, чтобы медиана и гистограммы не вырождались; значения в [20, 230],
+// иначе линейное растяжение оказалось бы тождественным и ничего не делало
+QImage MakeImage(const int width, const int height)
+{
+    QImage img(width, height, QImage::Format_RGB32);
+    mt19937 rng(width * 31 + height);
+
+    for (int j = 0; j < height; ++j)
+    {
+        QRgb* line = reinterpret_cast<QRgb*>(img.scanLine(j));
+
+        for (int i = 0; i < width; ++i)
+        {
+            const unsigned n = rng();
+            line[i] = qRgb(20 + (i * 180 / width + (n & 31)),
+                           20 + (j * 180 / height + ((n >> 8) & 31)),
+                           20 + ((n >> 16) & 0xFF) % 211);
+        }
+    }
+
+    return img;
+}
+
+const QImage& Source(const int width, const int height)
+{
+    static map<pair<int, int>, QImage> cache;
+
+    auto it = cache.find({ width, height });
+    if (it == cache.end())
+        it = cache.emplace(make_pair(width, height), MakeImage(width, height)).first;
+
+    return it->second;
+}
+
+const vector<pair<int, int>> Sizes = {
+    { 640, 480 },       // 0.3 Мпикс
+    { 1920, 1080 },     // 2 Мпикс
+    { 4000, 3000 },     // 12 Мпикс
+    { 8192, 6144 },     // 50 Мпикс
+};
+
+// каждая итерация начинает с копии исходного изображения: иначе операции вроде GrayWorld
+// брали бы статистику из кэша, а медиана работала бы по уже сглаженным данным
+template<typename Op>
+void RunOp(benchmark::State& state, Op op)
+{
+    const int width = static_cast<int>(state.range(0));
+    const int height = static_cast<int>(state.range(1));
+    const QImage& src = Source(width, height);
+
+    ImageProc proc;
+
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        QImage img = src.copy();
+        state.ResumeTiming();
+
+        op(proc, &img);
+        benchmark::DoNotOptimize(img.constBits());
+    }
+
+    state.counters["Mpix/s"] = benchmark::Counter(static_cast<double>(width) * height * state.iterations() / 1e6,
+                                                  benchmark::Counter::kIsRate);
+}
+
+// многопоточные операции: третий параметр - ограничение пула
+template<typename Op>
+void Threaded(const string& name, Op op)
+{
+    auto* b = benchmark::RegisterBenchmark(name.c_str(), [op](benchmark::State& state){
+        ThreadPool::Instance().SetMaxThreads(static_cast<unsigned>(state.range(2)));
+        RunOp(state, op);
+        ThreadPool::Instance().SetMaxThreads(0);
+    });
+
+    b->ArgNames({ "w", "h", "threads" })->Unit(benchmark::kMillisecond)->UseRealTime();
+    for (const auto& s : Sizes)
+        for (int threads : { 1, 0 })
+            b->Args({ s.first, s.second, threads });
+}
+
+// поточечные операции: третий параметр - уровень SIMD
+template<typename Op>
+void Simd(const string& name, Op op)
+{
+    auto* b = benchmark::RegisterBenchmark(name.c_str(), [op](benchmark::State& state){
+        SetSimdLevel(static_cast<SimdLevel>(state.range(2)));
+        RunOp(state, op);
+        SetSimdLevel(SimdLevel::AVX2);
+    });
+
+    b->ArgNames({ "w", "h", "simd" })->Unit(benchmark::kMillisecond)->UseRealTime();
+    for (const auto& s : Sizes)
+        for (SimdLevel level : { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2 })
+            b->Args({ s.first, s.second, static_cast<int>(level) });
+}
+
+void RegisterAll()
+{
+    Simd("GrayWorld", [](ImageProc& p, QImage* img){ p.GrayWorld(img); });
+    Simd("LinearCorr", [](ImageProc& p, QImage* img){ p.LinearCorr(img); });
+    Simd("GammaFunc", [](ImageProc& p, QImage* img){ p.GammaFunc(img, 1.2, 0.8); });
+
+    for (double sigma : { 0.84, 3.0, 10.0 })
+        Threaded("GaussBlur/sigma:" + to_string(sigma).substr(0, 4),
+                 [sigma](ImageProc& p, QImage* img){ p.GaussBlur(img, sigma); });
+
+    for (int ksz : { 3, 5, 7, 15, 31 })
+        Threaded("MedianFilter/ksz:" + to_string(ksz),
+                 [ksz](ImageProc& p, QImage* img){ p.MedianFilter(img, ksz); });
+
+    for (int ksz : { 3, 15, 63 })
+        Threaded("BoxFilter/ksz:" + to_string(ksz),
+                 [ksz](ImageProc& p, QImage* img){ p.BoxFilter(img, ksz, ksz); });
+
+    const vector<pair<string, vector<double>>> kernels = {
+        { "sharpen3", { 0, -1, 0, -1, 5, -1, 0, -1, 0 } },
+        { "box5", vector<double>(25, 1.0) },
+        // нули и симметричные пары - список слагаемых
+        { "emboss3", { -2, -1, 0, -1, 1, 1, 0, 1, 2 } },
+        { "cross9", [](){
+              vector<double> k(81, 0.0);
+              for (int i = 0; i < 9; ++i)
+                  k[i * 9 + 4] = k[4 * 9 + i] = 1.0;
+              return k;
+          }() },
+        { "random7", [](){
+              vector<double> k(49);
+              mt19937 rng(7);
+              for (auto& v : k)
+                  v = static_cast<int>(rng() % 9) - 2;
+              return k;
+          }() },
+        // ранг 1 и 2 - сепарабельные проходы, когда они дешевле плотной свёртки
+        { "gauss41", [](){
+              vector<double> k(41 * 41);
+              for (int x = 0; x < 41; ++x)
+                  for (int y = 0; y < 41; ++y)
+                      k[x * 41 + y] = exp(-((x - 20) * (x - 20) + (y - 20) * (y - 20)) / 200.0);
+              return k;
+          }() },
+        { "sobel-rank2-9", [](){
+              vector<double> k(81);
+              for (int x = 0; x < 9; ++x)
+                  for (int y = 0; y < 9; ++y)
+                      k[x * 9 + y] = (x - 4) * (y == 4 ? 2 : 1) + (y - 4) * (x == 4 ? 2 : 1);
+              return k;
+          }() },
+        // полного ранга и большое - блоки через БПФ
+        { "random63", [](){
+              vector<double> k(63 * 63);
+              mt19937 rng(63);
+              for (auto& v : k)
+                  v = static_cast<int>(rng() % 9) - 2;
+              return k;
+          }() },
+    };
+
+    for (const auto& k : kernels)
+    {
+        const vector<double> kernel = k.second;
+        auto op = [kernel](ImageProc& p, QImage* img){
+            vector<double> tmp = kernel;
+            p.CustomFilter(img, &tmp);
+        };
+
+        Threaded("CustomFilter/" + k.first, op);
+        // simd:0 - свёртка с 32-битными весами или в double, 1 и 2 - 16-битные веса в SIMD
+        Simd("CustomFilter/" + k.first, op);
+    }
+
+    for (int ksz : { 3, 15 })
+    {
+        Threaded("Erosion/ksz:" + to_string(ksz), [ksz](ImageProc& p, QImage* img){ p.Erosion(img, ksz); });
+        Threaded("Increase/ksz:" + to_string(ksz), [ksz](ImageProc& p, QImage* img){ p.Increase(img, ksz); });
+    }
+
+    Threaded("RotateLeft", [](ImageProc& p, QImage* img){ p.rotate_left(img); });
+    Threaded("RotateRight", [](ImageProc& p, QImage* img){ p.rotate_right(img); });
+    Threaded("Rotate180", [](ImageProc& p, QImage* img){ p.rotate_180(img); });
+
+    // цепочка фильтров: по шагам над QImage и над плоскостями с одной распаковкой (как в RunOpChain)
+    Threaded("Chain/packed", [](ImageProc& p, QImage* img){
+        p.MedianFilter(img, 3);
+        p.GaussBlur(img, 1.0);
+        p.MedianFilter(img, 3);
+        p.Erosion(img, 5);
+    });
+    Threaded("Chain/planar", [](ImageProc& p, QImage* img){
+        PlanarImage planar;
+        planar.assign(ViewOf(*img));
+        p.MedianFilter(&planar, 3);
+        p.GaussBlur(&planar, 1.0);
+        p.MedianFilter(&planar, 3);
+        p.Erosion(&planar, 5);
+        planar.store(MutableViewOf(*img));
+    });
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    RegisterAll();
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
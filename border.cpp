@@ -0,0 +1,83 @@
+#include "border.h"
+
+#include <algorithm>
+
+#include "tonelut.h"
+
+template<typename T>
+void BasicPaddedTile<T>::fill(const BasicImageView<const T>& src, const int x0, const int x1, const int y0, const int y1,
+                              const int rx, const int ry, const BorderMode mode, const T constant)
+{
+    const int width = src.width();
+    const int height = src.height();
+
+    this->x0 = x0;
+    this->rx = rx;
+    stride = x1 - x0 + 2 * rx;
+    top = y0 - ry;
+
+    const int rows = y1 - y0 + 2 * ry;
+    pixels.resize(static_cast<size_t>(stride) * rows);
+
+    // столбцы внутри изображения копируются одним куском, поля - по таблице индексов
+    const int left = x0 - rx;
+    const int in_begin = std::max(0, left) - left;
+    const int in_end = std::min(width, x1 + rx) - left;
+
+    std::vector<int> xs(stride);
+    for (int t = 0; t < stride; ++t)
+        xs[t] = BorderIndex(left + t, width, mode);
+
+    for (int r = 0; r < rows; ++r)
+    {
+        T* out = pixels.data() + static_cast<size_t>(r) * stride;
+        const int sy = BorderIndex(top + r, height, mode);
+
+        if (sy < 0)
+        {
+            std::fill(out, out + stride, constant);
+            continue;
+        }
+
+        const T* in = src.line(sy);
+
+        for (int t = 0; t < in_begin; ++t)
+            out[t] = xs[t] < 0 ? constant : in[xs[t]];
+
+        std::copy(in + left + in_begin, in + left + in_end, out + in_begin);
+
+        for (int t = in_end; t < stride; ++t)
+            out[t] = xs[t] < 0 ? constant : in[xs[t]];
+    }
+}
+
+template<>
+void BasicPaddedTile<QRgb>::fill(const ConstImageView& src, const int x0, const int x1, const int y0, const int y1,
+                                 const int rx, const int ry, const Border& border)
+{
+    fill(src, x0, x1, y0, y1, rx, ry, border.mode, border.constant);
+
+    if (!border.tone)
+        return;
+
+    if (border.mode != BorderMode::Constant)
+    {
+        border.tone->apply(pixels.data(), pixels.size());
+        return;
+    }
+
+    // цвет за краем задан для результата отложенного преобразования, его не трогаем:
+    // пиксели изображения - строки внутри него, в каждой - один непрерывный отрезок столбцов
+    const int left = x0 - rx;
+    const int in_begin = std::max(0, left) - left;
+    const int in_end = std::min(src.width(), x1 + rx) - left;
+
+    const int rows = static_cast<int>(pixels.size() / stride);
+    const int y_end = std::min(top + rows, src.height());
+
+    for (int y = std::max(top, 0); y < y_end; ++y)
+        border.tone->apply(pixels.data() + static_cast<size_t>(y - top) * stride + in_begin, in_end - in_begin);
+}
+
+template void BasicPaddedTile<QRgb>::fill(const ConstImageView&, int, int, int, int, int, int, BorderMode, QRgb);
+template void BasicPaddedTile<uchar>::fill(const ConstPlaneView&, int, int, int, int, int, int, BorderMode, uchar);
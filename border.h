@@ -0,0 +1,100 @@
+#ifndef BORDER_H
+#define BORDER_H
+
+#include <QImage>
+#include <QRgb>
+
+#include <vector>
+
+#include "imageview.h"
+
+//  Что фильтры видят за краем изображения (n - длина строки или столбца):
+//  Reflect     зеркально с повтором крайнего: ... c b a | a b c ... (как было всегда)
+//  Reflect101  зеркально без повтора:         ... c b | a b c ...
+//  Replicate   крайний пиксель:               ... a a | a b c ...
+//  Constant    заданный цвет
+//  Wrap        с противоположного края:       ... y z | a b c ...
+enum class BorderMode { Reflect, Reflect101, Replicate, Constant, Wrap };
+
+class ToneLut;
+
+struct Border
+{
+    BorderMode mode = BorderMode::Reflect;
+    QRgb constant = 0xFF000000;     // для Constant
+    const ToneLut* tone = nullptr;  // отложенное тоновое преобразование пикселей изображения (не constant),
+                                    // применяется при загрузке тайла
+};
+
+// индекс в [0, n) для любого x; -1 для Constant за краем
+inline int BorderIndex(int x, const int n, const BorderMode mode) noexcept
+{
+    if (x >= 0 && x < n)
+        return x;
+
+    switch (mode)
+    {
+    case BorderMode::Reflect:
+        x %= 2 * n;
+        if (x < 0) x += 2 * n;
+        return x < n ? x : 2 * n - 1 - x;
+
+    case BorderMode::Reflect101:
+        if (n == 1)
+            return 0;
+        x %= 2 * n - 2;
+        if (x < 0) x += 2 * n - 2;
+        return x < n ? x : 2 * n - 2 - x;
+
+    case BorderMode::Replicate:
+        return x < 0 ? 0 : n - 1;
+
+    case BorderMode::Wrap:
+        x %= n;
+        return x < 0 ? x + n : x;
+
+    default:
+        return -1;
+    }
+}
+
+//  Прямоугольник [x0, x1) x [y0, y1) изображения src с полями rx по горизонтали и ry по вертикали,
+//  заполненными по правилу Border. Заполняется один раз на полосу или кусок, после чего
+//  внутренние циклы фильтров читают окно без проверок границ.
+//  T - QRgb (PaddedTile, упакованные пиксели) или uchar (PlaneTile, одна плоскость PlanarImage).
+template<typename T>
+class BasicPaddedTile
+{
+public:
+    // constant - значение за краем для BorderMode::Constant; определено в border.cpp для QRgb и uchar
+    void fill(const BasicImageView<const T>& src, int x0, int x1, int y0, int y1, int rx, int ry,
+              BorderMode mode, T constant);
+
+    // только для PaddedTile: значение за краем и border.tone
+    void fill(const BasicImageView<const T>& src, int x0, int x1, int y0, int y1, int rx, int ry,
+              const Border& border);
+
+    // строка y изображения (y0 - ry <= y < y1 + ry); индекс 0 - столбец x0, допустимы [-rx, x1 - x0 + rx)
+    inline const T* line(const int y) const noexcept
+    {
+        return pixels.data() + static_cast<size_t>(y - top) * stride + rx;
+    }
+
+    inline T at(const int x, const int y) const noexcept { return line(y)[x - x0]; }
+
+private:
+    std::vector<T> pixels;
+    int stride = 0;
+    int top = 0;
+    int x0 = 0;
+    int rx = 0;
+};
+
+template<>
+void BasicPaddedTile<QRgb>::fill(const ConstImageView& src, int x0, int x1, int y0, int y1, int rx, int ry,
+                                 const Border& border);
+
+using PaddedTile = BasicPaddedTile<QRgb>;
+using PlaneTile = BasicPaddedTile<uchar>;
+
+#endif // BORDER_H
@@ -0,0 +1,913 @@
+#include "convolve.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <type_traits>
+
+#include "border.h"
+#include "matrix.h"
+#include "pointops.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CONVOLVE_X86
+#include <immintrin.h>
+#endif
+
+// как в pointops.cpp: GCC/Clang требуют явно разрешить набор инструкций для функции
+#if defined(__GNUC__) || defined(__clang__)
+#define CONVOLVE_TARGET(x) __attribute__((target(x)))
+#else
+#define CONVOLVE_TARGET(x)
+#endif
+
+namespace {
+
+// f(0), f(1), ..., f(N - 1) с индексом - константой времени компиляции
+template<int N>
+struct Unroll
+{
+    template<typename F>
+    static inline void Run(F&& f)
+    {
+        Unroll<N - 1>::Run(f);
+        f(std::integral_constant<int, N - 1>());
+    }
+};
+
+template<>
+struct Unroll<0>
+{
+    template<typename F>
+    static inline void Run(F&&) {}
+};
+
+inline uchar clamp8(const int x) noexcept
+{
+    return static_cast<uchar>(x < 0 ? 0 : (x > 255 ? 255 : x));
+}
+
+struct Acc
+{
+    int r, g, b;
+
+    explicit Acc(const int init) : r(init), g(init), b(init) {}
+
+    inline void add(const int w, const QRgb c) noexcept
+    {
+        r += w * qRed(c);
+        g += w * qGreen(c);
+        b += w * qBlue(c);
+    }
+};
+
+// lines[y][i - h + x] - пиксель со смещением (x, y) ядра; поля уже заполнены PaddedTile
+template<int N>
+inline QRgb ConvolvePixel(const QRgb* const* lines, const int i, const SMatrix<int, N, N>& taps,
+                          const int shift, const int bias)
+{
+    constexpr int h = N / 2;
+
+    Acc a(bias);
+
+    Unroll<N>::Run([&](auto x){
+        const int pos = i - h + x;
+        Unroll<N>::Run([&](auto y){ a.add(taps[x][y], lines[y][pos]); });
+    });
+
+    return qRgb(clamp8(a.r >> shift), clamp8(a.g >> shift), clamp8(a.b >> shift));
+}
+
+template<int N>
+void ConvolveN(const ConstImageView& src, const ImageView& dst, const FixedKernel& k, const Border& border,
+               const int begin_y, const int end_y)
+{
+    constexpr int h = N / 2;
+
+    const int width = src.width();
+
+    SMatrix<int, N, N> taps;
+    std::copy(k.taps.begin(), k.taps.end(), taps.begin());
+
+    PaddedTile tile;
+    tile.fill(src, 0, width, begin_y, end_y, h, h, border);
+
+    const QRgb* lines[N];
+
+    for (int j = begin_y; j < end_y; ++j)
+    {
+        for (int y = 0; y < N; ++y)
+            lines[y] = tile.line(j - h + y);
+
+        QRgb* out = dst.line(j);
+
+        for (int i = 0; i < width; ++i)
+            out[i] = ConvolvePixel<N>(lines, i, taps, k.shift, k.bias);
+    }
+}
+
+// горизонтальный проход: сумма с 2^14 сокращается до 8 дробных бит (не больше 255 * 256)
+template<int N>
+void SeparableRowsN(const ConstImageView& src, ushort* tmp, const FixedKernel& k, const Border& border,
+                    const int begin_y, const int end_y)
+{
+    constexpr int h = N / 2;
+    constexpr int drop = 14 - 8;
+
+    const int width = src.width();
+
+    SMatrix<int, 1, N> taps;
+    std::copy(k.taps.begin(), k.taps.end(), taps.begin());
+
+    PaddedTile tile;
+    tile.fill(src, 0, width, begin_y, end_y, h, 0, border);
+
+    for (int j = begin_y; j < end_y; ++j)
+    {
+        const QRgb* line = tile.line(j);
+        ushort* out = tmp + 3 * static_cast<size_t>(j) * width;
+
+        for (int i = 0; i < width; ++i)
+        {
+            Acc a(1 << (drop - 1));
+            Unroll<N>::Run([&](auto x){ a.add(taps[0][x], line[i - h + x]); });
+
+            out[3 * i] = static_cast<ushort>(a.r >> drop);
+            out[3 * i + 1] = static_cast<ushort>(a.g >> drop);
+            out[3 * i + 2] = static_cast<ushort>(a.b >> drop);
+        }
+    }
+}
+
+// вертикальный проход: 8 + 14 дробных бит, округление до ближайшего
+template<int N>
+void SeparableColsN(const ushort* tmp, const ImageView& dst, const FixedKernel& k, const Border& border,
+                    const int begin_y, const int end_y)
+{
+    const int width = dst.width();
+    const int height = dst.height();
+
+    constexpr int h = N / 2;
+    constexpr int shift = 8 + 14;
+
+    const size_t row_sz = 3 * static_cast<size_t>(width);
+
+    SMatrix<int, 1, N> taps;
+    std::copy(k.taps.begin(), k.taps.end(), taps.begin());
+
+    // строки за краем берутся целиком из tmp; для Constant - строка постоянного цвета
+    std::vector<ushort> constant;
+    if (border.mode == BorderMode::Constant)
+    {
+        constant.resize(row_sz);
+        for (size_t p = 0; p < row_sz; p += 3)
+        {
+            constant[p] = static_cast<ushort>(qRed(border.constant) << 8);
+            constant[p + 1] = static_cast<ushort>(qGreen(border.constant) << 8);
+            constant[p + 2] = static_cast<ushort>(qBlue(border.constant) << 8);
+        }
+    }
+
+    const ushort* rows[N];
+
+    for (int j = begin_y; j < end_y; ++j)
+    {
+        for (int y = 0; y < N; ++y)
+        {
+            const int sy = BorderIndex(j - h + y, height, border.mode);
+            rows[y] = sy < 0 ? constant.data() : tmp + sy * row_sz;
+        }
+
+        QRgb* line = dst.line(j);
+
+        for (int i = 0; i < width; ++i)
+        {
+            const size_t p = 3 * static_cast<size_t>(i);
+            Acc a(1 << (shift - 1));
+
+            Unroll<N>::Run([&](auto y){
+                const int w = taps[0][y];
+                a.r += w * rows[y][p];
+                a.g += w * rows[y][p + 1];
+                a.b += w * rows[y][p + 2];
+            });
+
+            line[i] = qRgb(clamp8(a.r >> shift), clamp8(a.g >> shift), clamp8(a.b >> shift));
+        }
+    }
+}
+
+// Те же проходы по одной плоскости: значения канала идут подряд, поэтому цикл по i
+// векторизуется без перестановок байт. Арифметика та же, результат совпадает с каналом
+// SeparableRowsN / SeparableColsN.
+template<int N>
+void SeparableRowsPlaneN(const ConstPlaneView& src, ushort* tmp, const FixedKernel& k, const BorderMode mode,
+                         const uchar edge, const int begin_y, const int end_y)
+{
+    constexpr int h = N / 2;
+    constexpr int drop = 14 - 8;
+
+    const int width = src.width();
+
+    SMatrix<int, 1, N> taps;
+    std::copy(k.taps.begin(), k.taps.end(), taps.begin());
+
+    PlaneTile tile;
+    tile.fill(src, 0, width, begin_y, end_y, h, 0, mode, edge);
+
+    for (int j = begin_y; j < end_y; ++j)
+    {
+        const uchar* line = tile.line(j) - h;
+        ushort* out = tmp + static_cast<size_t>(j) * width;
+
+        for (int i = 0; i < width; ++i)
+        {
+            int a = 1 << (drop - 1);
+            Unroll<N>::Run([&](auto x){ a += taps[0][x] * line[i + x]; });
+
+            out[i] = static_cast<ushort>(a >> drop);
+        }
+    }
+}
+
+template<int N>
+void SeparableColsPlaneN(const ushort* tmp, const PlaneView& dst, const FixedKernel& k, const BorderMode mode,
+                         const uchar edge, const int begin_y, const int end_y)
+{
+    constexpr int h = N / 2;
+    constexpr int shift = 8 + 14;
+
+    const int width = dst.width();
+    const int height = dst.height();
+
+    SMatrix<int, 1, N> taps;
+    std::copy(k.taps.begin(), k.taps.end(), taps.begin());
+
+    std::vector<ushort> constant;
+    if (mode == BorderMode::Constant)
+        constant.assign(width, static_cast<ushort>(edge << 8));
+
+    const ushort* rows[N];
+
+    for (int j = begin_y; j < end_y; ++j)
+    {
+        for (int y = 0; y < N; ++y)
+        {
+            const int sy = BorderIndex(j - h + y, height, mode);
+            rows[y] = sy < 0 ? constant.data() : tmp + static_cast<size_t>(sy) * width;
+        }
+
+        uchar* line = dst.line(j);
+
+        for (int i = 0; i < width; ++i)
+        {
+            int a = 1 << (shift - 1);
+            Unroll<N>::Run([&](auto y){ a += taps[0][y] * rows[y][i]; });
+
+            line[i] = clamp8(a >> shift);
+        }
+    }
+}
+
+// веса w / div * 2^shift, |вес| <= max_tap
+bool Quantize(const std::vector<double>& kernel, const double div, const double max_tap, FixedKernel* out)
+{
+    const int ksz = static_cast<int>(std::lround(std::sqrt(kernel.size())));
+    const int64_t n = static_cast<int64_t>(kernel.size());
+
+    // ошибка округления весов - до 0.5 на вес и 255 на пиксель; bias сдвигает сумму так,
+    // чтобы она была не меньше точной, и точное целое не превращалось в предыдущее
+    const int64_t bias = (255 * n + 1) / 2;
+
+    // сумма может превысить точную на 255 * n / 2^shift, это должно быть не больше 1 уровня
+    int min_shift = 0;
+    while ((int64_t(1) << min_shift) < 255 * n)
+        ++min_shift;
+
+    // самый большой сдвиг, при котором веса и сумма по модулю помещаются в свои типы
+    for (int shift = 22; shift >= min_shift; --shift)
+    {
+        const double scale = std::ldexp(1.0, shift);
+
+        std::vector<int> taps(kernel.size());
+        int64_t abs_sum = 0;
+        bool fits = true;
+
+        for (size_t i = 0; i < kernel.size() && fits; ++i)
+        {
+            const double q = std::round(kernel[i] / div * scale);
+            fits = std::fabs(q) <= max_tap;
+
+            if (fits)
+            {
+                taps[i] = static_cast<int>(q);
+                abs_sum += std::abs(static_cast<int64_t>(taps[i]));
+            }
+        }
+
+        if (fits && abs_sum * 255 + bias <= INT32_MAX)
+        {
+            out->ksz = ksz;
+            out->shift = shift;
+            out->bias = static_cast<int>(bias);
+            out->taps = std::move(taps);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// веса для pmaddwd: пары соседних по горизонтали (x, x + 1) в одном int32, младшая половина - x;
+// при нечётном ksz последняя пара дополнена нулём. Порядок: [y][пара]
+std::vector<int> PairTaps(const FixedKernel& k)
+{
+    const int n = k.ksz;
+    std::vector<int> pairs;
+
+    for (int y = 0; y < n; ++y)
+    {
+        for (int x = 0; x < n; x += 2)
+        {
+            const uint32_t w0 = static_cast<uint32_t>(k.taps[x * n + y]) & 0xFFFFu;
+            const uint32_t w1 = (x + 1 < n) ? static_cast<uint32_t>(k.taps[(x + 1) * n + y]) : 0u;
+
+            pairs.push_back(static_cast<int>((w1 << 16) | w0));
+        }
+    }
+
+    return pairs;
+}
+
+// веса соседних слагаемых (2p, 2p + 1) списка для pmaddwd, как у PairTaps; при нечётном числе
+// слагаемых последнее дополнено нулём
+std::vector<int> TapPairs(const TapKernel& k)
+{
+    const size_t n = k.terms.size();
+    std::vector<int> pairs;
+
+    for (size_t t = 0; t < n; t += 2)
+    {
+        const uint32_t w0 = static_cast<uint32_t>(k.terms[t].weight) & 0xFFFFu;
+        const uint32_t w1 = (t + 1 < n) ? static_cast<uint32_t>(k.terms[t + 1].weight) : 0u;
+
+        pairs.push_back(static_cast<int>((w1 << 16) | w0));
+    }
+
+    return pairs;
+}
+
+// пиксели [first, last) строки; lines[y][i - h + x] - пиксель со смещением (x, y) ядра
+void Row16Scalar(const QRgb* const* lines, QRgb* out, const FixedKernel& k, const int first, const int last)
+{
+    const int n = k.ksz;
+    const int h = n / 2;
+
+    for (int i = first; i < last; ++i)
+    {
+        Acc a(k.bias);
+        const int* w = k.taps.data();
+
+        for (int x = 0; x < n; ++x)
+        {
+            const int pos = i - h + x;
+
+            for (int y = 0; y < n; ++y, ++w)
+                a.add(*w, lines[y][pos]);
+        }
+
+        out[i] = qRgb(clamp8(a.r >> k.shift), clamp8(a.g >> k.shift), clamp8(a.b >> k.shift));
+    }
+}
+
+// Пиксели [first, last) строки по списку слагаемых: terms[t] читает ptrs[2t][i] и ptrs[2t + 1][i]
+void RowTapsScalar(const QRgb* const* ptrs, QRgb* out, const TapKernel& k, const int first, const int last)
+{
+    const size_t n = k.terms.size();
+
+    for (int i = first; i < last; ++i)
+    {
+        Acc a(k.bias);
+
+        for (size_t t = 0; t < n; ++t)
+        {
+            const TapTerm& term = k.terms[t];
+            const QRgb c0 = ptrs[2 * t][i];
+
+            if (term.sign == 0)
+            {
+                a.add(term.weight, c0);
+                continue;
+            }
+
+            const QRgb c1 = ptrs[2 * t + 1][i];
+            const int s = term.sign;
+
+            a.r += term.weight * (qRed(c0) + s * qRed(c1));
+            a.g += term.weight * (qGreen(c0) + s * qGreen(c1));
+            a.b += term.weight * (qBlue(c0) + s * qBlue(c1));
+        }
+
+        out[i] = qRgb(clamp8(a.r >> k.shift), clamp8(a.g >> k.shift), clamp8(a.b >> k.shift));
+    }
+}
+
+#if defined(CONVOLVE_X86)
+
+// Блоки по 4 пикселя начиная с i. Для пары весов (x, x + 1) читаются две строки по 4 пикселя со
+// сдвигом на один; после чередования 16-битных каналов pmaddwd даёт w0 * p[x] + w1 * p[x + 1]
+// сразу по четырём каналам одного выходного пикселя. Возвращает первый необработанный пиксель.
+CONVOLVE_TARGET("sse2")
+int Row16SSE2(const QRgb* const* lines, QRgb* out, const FixedKernel& k, const int* pairs,
+              int i, const int last)
+{
+    const int n = k.ksz;
+    const int h = n / 2;
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi32(k.bias);
+    const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+    const __m128i shift = _mm_cvtsi32_si128(k.shift);
+
+    for (; i + 4 <= last; i += 4)
+    {
+        __m128i acc0 = bias;
+        __m128i acc1 = bias;
+        __m128i acc2 = bias;
+        __m128i acc3 = bias;
+
+        const int* w = pairs;
+
+        for (int y = 0; y < n; ++y)
+        {
+            const QRgb* src = lines[y] + i - h;
+
+            for (int x = 0; x < n; x += 2, ++w)
+            {
+                const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+                const __m128i b = (x + 1 < n) ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x + 1)) : a;
+                const __m128i wv = _mm_set1_epi32(*w);
+
+                const __m128i alo = _mm_unpacklo_epi8(a, zero);
+                const __m128i ahi = _mm_unpackhi_epi8(a, zero);
+                const __m128i blo = _mm_unpacklo_epi8(b, zero);
+                const __m128i bhi = _mm_unpackhi_epi8(b, zero);
+
+                acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi16(alo, blo), wv));
+                acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi16(alo, blo), wv));
+                acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(_mm_unpacklo_epi16(ahi, bhi), wv));
+                acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(_mm_unpackhi_epi16(ahi, bhi), wv));
+            }
+        }
+
+        // арифметический сдвиг и насыщающая упаковка - то же, что clamp8(a >> shift)
+        acc0 = _mm_sra_epi32(acc0, shift);
+        acc1 = _mm_sra_epi32(acc1, shift);
+        acc2 = _mm_sra_epi32(acc2, shift);
+        acc3 = _mm_sra_epi32(acc3, shift);
+
+        const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(acc0, acc1), _mm_packs_epi32(acc2, acc3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_or_si128(packed, alpha));
+    }
+
+    return i;
+}
+
+// то же по 8 пикселей; распаковка и упаковка идут внутри 128-битных половин, поэтому
+// порядок пикселей после упаковки восстанавливается сам
+CONVOLVE_TARGET("avx2")
+int Row16AVX2(const QRgb* const* lines, QRgb* out, const FixedKernel& k, const int* pairs,
+              int i, const int last)
+{
+    const int n = k.ksz;
+    const int h = n / 2;
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i bias = _mm256_set1_epi32(k.bias);
+    const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xFF000000u));
+    const __m128i shift = _mm_cvtsi32_si128(k.shift);
+
+    for (; i + 8 <= last; i += 8)
+    {
+        __m256i acc0 = bias;
+        __m256i acc1 = bias;
+        __m256i acc2 = bias;
+        __m256i acc3 = bias;
+
+        const int* w = pairs;
+
+        for (int y = 0; y < n; ++y)
+        {
+            const QRgb* src = lines[y] + i - h;
+
+            for (int x = 0; x < n; x += 2, ++w)
+            {
+                const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x));
+                const __m256i b = (x + 1 < n) ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + x + 1)) : a;
+                const __m256i wv = _mm256_set1_epi32(*w);
+
+                const __m256i alo = _mm256_unpacklo_epi8(a, zero);
+                const __m256i ahi = _mm256_unpackhi_epi8(a, zero);
+                const __m256i blo = _mm256_unpacklo_epi8(b, zero);
+                const __m256i bhi = _mm256_unpackhi_epi8(b, zero);
+
+                acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_unpacklo_epi16(alo, blo), wv));
+                acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_unpackhi_epi16(alo, blo), wv));
+                acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(_mm256_unpacklo_epi16(ahi, bhi), wv));
+                acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(_mm256_unpackhi_epi16(ahi, bhi), wv));
+            }
+        }
+
+        acc0 = _mm256_sra_epi32(acc0, shift);
+        acc1 = _mm256_sra_epi32(acc1, shift);
+        acc2 = _mm256_sra_epi32(acc2, shift);
+        acc3 = _mm256_sra_epi32(acc3, shift);
+
+        const __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(acc0, acc1), _mm256_packs_epi32(acc2, acc3));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_or_si256(packed, alpha));
+    }
+
+    return i;
+}
+
+// каналы 4 пикселей слагаемого в 16 битах: p0[i..i+3] (+ или -) p1[i..i+3]
+CONVOLVE_TARGET("sse2")
+inline void TermSSE2(const QRgb* p0, const QRgb* p1, const int sign, __m128i* lo, __m128i* hi)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p0));
+
+    *lo = _mm_unpacklo_epi8(a, zero);
+    *hi = _mm_unpackhi_epi8(a, zero);
+
+    if (sign == 0)
+        return;
+
+    const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p1));
+    const __m128i blo = _mm_unpacklo_epi8(b, zero);
+    const __m128i bhi = _mm_unpackhi_epi8(b, zero);
+
+    *lo = sign > 0 ? _mm_add_epi16(*lo, blo) : _mm_sub_epi16(*lo, blo);
+    *hi = sign > 0 ? _mm_add_epi16(*hi, bhi) : _mm_sub_epi16(*hi, bhi);
+}
+
+// Как Row16SSE2, но пара весов для pmaddwd - два слагаемых списка (pairs из TapPairs);
+// значения слагаемых с парой - от -255 до 510, в int16 помещаются
+CONVOLVE_TARGET("sse2")
+int RowTapsSSE2(const QRgb* const* ptrs, QRgb* out, const TapKernel& k, const int* pairs,
+                int i, const int last)
+{
+    const size_t n = k.terms.size();
+
+    const __m128i bias = _mm_set1_epi32(k.bias);
+    const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+    const __m128i shift = _mm_cvtsi32_si128(k.shift);
+
+    for (; i + 4 <= last; i += 4)
+    {
+        __m128i acc0 = bias;
+        __m128i acc1 = bias;
+        __m128i acc2 = bias;
+        __m128i acc3 = bias;
+
+        for (size_t t = 0; t < n; t += 2)
+        {
+            __m128i alo, ahi, blo, bhi;
+            TermSSE2(ptrs[2 * t] + i, ptrs[2 * t + 1] + i, k.terms[t].sign, &alo, &ahi);
+
+            if (t + 1 < n)
+                TermSSE2(ptrs[2 * t + 2] + i, ptrs[2 * t + 3] + i, k.terms[t + 1].sign, &blo, &bhi);
+            else {
+                blo = alo;
+                bhi = ahi;
+            }
+
+            const __m128i wv = _mm_set1_epi32(pairs[t / 2]);
+
+            acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi16(alo, blo), wv));
+            acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi16(alo, blo), wv));
+            acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(_mm_unpacklo_epi16(ahi, bhi), wv));
+            acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(_mm_unpackhi_epi16(ahi, bhi), wv));
+        }
+
+        acc0 = _mm_sra_epi32(acc0, shift);
+        acc1 = _mm_sra_epi32(acc1, shift);
+        acc2 = _mm_sra_epi32(acc2, shift);
+        acc3 = _mm_sra_epi32(acc3, shift);
+
+        const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(acc0, acc1), _mm_packs_epi32(acc2, acc3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_or_si128(packed, alpha));
+    }
+
+    return i;
+}
+
+CONVOLVE_TARGET("avx2")
+inline void TermAVX2(const QRgb* p0, const QRgb* p1, const int sign, __m256i* lo, __m256i* hi)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p0));
+
+    *lo = _mm256_unpacklo_epi8(a, zero);
+    *hi = _mm256_unpackhi_epi8(a, zero);
+
+    if (sign == 0)
+        return;
+
+    const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p1));
+    const __m256i blo = _mm256_unpacklo_epi8(b, zero);
+    const __m256i bhi = _mm256_unpackhi_epi8(b, zero);
+
+    *lo = sign > 0 ? _mm256_add_epi16(*lo, blo) : _mm256_sub_epi16(*lo, blo);
+    *hi = sign > 0 ? _mm256_add_epi16(*hi, bhi) : _mm256_sub_epi16(*hi, bhi);
+}
+
+CONVOLVE_TARGET("avx2")
+int RowTapsAVX2(const QRgb* const* ptrs, QRgb* out, const TapKernel& k, const int* pairs,
+                int i, const int last)
+{
+    const size_t n = k.terms.size();
+
+    const __m256i bias = _mm256_set1_epi32(k.bias);
+    const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xFF000000u));
+    const __m128i shift = _mm_cvtsi32_si128(k.shift);
+
+    for (; i + 8 <= last; i += 8)
+    {
+        __m256i acc0 = bias;
+        __m256i acc1 = bias;
+        __m256i acc2 = bias;
+        __m256i acc3 = bias;
+
+        for (size_t t = 0; t < n; t += 2)
+        {
+            __m256i alo, ahi, blo, bhi;
+            TermAVX2(ptrs[2 * t] + i, ptrs[2 * t + 1] + i, k.terms[t].sign, &alo, &ahi);
+
+            if (t + 1 < n)
+                TermAVX2(ptrs[2 * t + 2] + i, ptrs[2 * t + 3] + i, k.terms[t + 1].sign, &blo, &bhi);
+            else {
+                blo = alo;
+                bhi = ahi;
+            }
+
+            const __m256i wv = _mm256_set1_epi32(pairs[t / 2]);
+
+            acc0 = _mm256_add_epi32(acc0, _mm256_madd_epi16(_mm256_unpacklo_epi16(alo, blo), wv));
+            acc1 = _mm256_add_epi32(acc1, _mm256_madd_epi16(_mm256_unpackhi_epi16(alo, blo), wv));
+            acc2 = _mm256_add_epi32(acc2, _mm256_madd_epi16(_mm256_unpacklo_epi16(ahi, bhi), wv));
+            acc3 = _mm256_add_epi32(acc3, _mm256_madd_epi16(_mm256_unpackhi_epi16(ahi, bhi), wv));
+        }
+
+        acc0 = _mm256_sra_epi32(acc0, shift);
+        acc1 = _mm256_sra_epi32(acc1, shift);
+        acc2 = _mm256_sra_epi32(acc2, shift);
+        acc3 = _mm256_sra_epi32(acc3, shift);
+
+        const __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(acc0, acc1), _mm256_packs_epi32(acc2, acc3));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_or_si256(packed, alpha));
+    }
+
+    return i;
+}
+
+#endif // CONVOLVE_X86
+
+}
+
+bool HasFixedKernel(const int ksz)
+{
+    return ksz == 3 || ksz == 5 || ksz == 7 || ksz == 9;
+}
+
+bool QuantizeKernel(const std::vector<double>& kernel, const double div, FixedKernel* out)
+{
+    return Quantize(kernel, div, 2147483647.0, out);
+}
+
+bool QuantizeKernel16(const std::vector<double>& kernel, const double div, FixedKernel* out)
+{
+    return Quantize(kernel, div, 32767.0, out);
+}
+
+FixedKernel QuantizeSeparable(const std::vector<float>& kernel)
+{
+    constexpr int one = 1 << 14;
+
+    FixedKernel k;
+    k.ksz = static_cast<int>(kernel.size());
+    k.shift = 14;
+    k.taps.resize(kernel.size());
+
+    int sum = 0;
+    for (size_t i = 0; i < kernel.size(); ++i)
+        sum += k.taps[i] = static_cast<int>(std::lround(kernel[i] * one));
+
+    k.taps[kernel.size() / 2] += one - sum;
+
+    return k;
+}
+
+void ConvolveFixed(const ConstImageView& src, const ImageView& dst, const FixedKernel& k, const Border& border,
+                   const int begin_y, const int end_y)
+{
+    switch (k.ksz)
+    {
+    case 3: ConvolveN<3>(src, dst, k, border, begin_y, end_y); break;
+    case 5: ConvolveN<5>(src, dst, k, border, begin_y, end_y); break;
+    case 7: ConvolveN<7>(src, dst, k, border, begin_y, end_y); break;
+    case 9: ConvolveN<9>(src, dst, k, border, begin_y, end_y); break;
+    }
+}
+
+void SeparableRowsFixed(const ConstImageView& src, ushort* tmp, const FixedKernel& k, const Border& border,
+                        const int begin_y, const int end_y)
+{
+    switch (k.ksz)
+    {
+    case 3: SeparableRowsN<3>(src, tmp, k, border, begin_y, end_y); break;
+    case 5: SeparableRowsN<5>(src, tmp, k, border, begin_y, end_y); break;
+    case 7: SeparableRowsN<7>(src, tmp, k, border, begin_y, end_y); break;
+    case 9: SeparableRowsN<9>(src, tmp, k, border, begin_y, end_y); break;
+    }
+}
+
+void SeparableColsFixed(const ushort* tmp, const ImageView& dst, const FixedKernel& k, const Border& border,
+                        const int begin_y, const int end_y)
+{
+    switch (k.ksz)
+    {
+    case 3: SeparableColsN<3>(tmp, dst, k, border, begin_y, end_y); break;
+    case 5: SeparableColsN<5>(tmp, dst, k, border, begin_y, end_y); break;
+    case 7: SeparableColsN<7>(tmp, dst, k, border, begin_y, end_y); break;
+    case 9: SeparableColsN<9>(tmp, dst, k, border, begin_y, end_y); break;
+    }
+}
+
+void ConvolveFixed16(const ConstImageView& src, const ImageView& dst, const FixedKernel& k, const Border& border,
+                     const int begin_y, const int end_y)
+{
+    const int n = k.ksz;
+    const int h = n / 2;
+
+    const int width = src.width();
+
+    PaddedTile tile;
+    tile.fill(src, 0, width, begin_y, end_y, h, h, border);
+
+    const std::vector<int> pairs = PairTaps(k);
+    std::vector<const QRgb*> lines(n);
+
+    const SimdLevel level = ActiveSimdLevel();
+
+    for (int j = begin_y; j < end_y; ++j)
+    {
+        for (int y = 0; y < n; ++y)
+            lines[y] = tile.line(j - h + y);
+
+        QRgb* out = dst.line(j);
+
+        int i = 0;
+
+#if defined(CONVOLVE_X86)
+        if (level == SimdLevel::AVX2)
+            i = Row16AVX2(lines.data(), out, k, pairs.data(), 0, width);
+        else if (level == SimdLevel::SSE2)
+            i = Row16SSE2(lines.data(), out, k, pairs.data(), 0, width);
+#else
+        (void)level;
+#endif
+
+        Row16Scalar(lines.data(), out, k, i, width);
+    }
+}
+
+int TapKernel::folded() const
+{
+    int n = 0;
+    for (const TapTerm& t : terms)
+        n += t.sign != 0;
+
+    return n;
+}
+
+TapKernel CompileTaps(const FixedKernel& k)
+{
+    const int n = k.ksz;
+
+    TapKernel out;
+    out.ksz = n;
+    out.shift = k.shift;
+    out.bias = k.bias;
+    out.fits16 = true;
+
+    std::vector<bool> used(k.taps.size(), false);
+
+    for (int x = 0; x < n; ++x)
+    {
+        for (int y = 0; y < n; ++y)
+        {
+            const int w = k.taps[x * n + y];
+
+            if (w == 0 || used[x * n + y])
+                continue;
+
+            used[x * n + y] = true;
+
+            TapTerm term;
+            term.x0 = term.x1 = x;
+            term.y0 = term.y1 = y;
+            term.weight = w;
+
+            // отражения относительно центра, вертикальной и горизонтальной осей
+            const int mirrors[3][2] = { { n - 1 - x, n - 1 - y }, { n - 1 - x, y }, { x, n - 1 - y } };
+
+            for (const auto& m : mirrors)
+            {
+                const int at = m[0] * n + m[1];
+
+                if (used[at] || (k.taps[at] != w && k.taps[at] != -w))
+                    continue;
+
+                used[at] = true;
+                term.x1 = m[0];
+                term.y1 = m[1];
+                term.sign = k.taps[at] == w ? 1 : -1;
+                break;
+            }
+
+            out.fits16 = out.fits16 && w >= -32768 && w <= 32767;
+            out.terms.push_back(term);
+        }
+    }
+
+    return out;
+}
+
+void ConvolveTaps(const ConstImageView& src, const ImageView& dst, const TapKernel& k, const Border& border,
+                  const int begin_y, const int end_y)
+{
+    const int h = k.ksz / 2;
+    const size_t n = k.terms.size();
+
+    const int width = src.width();
+
+    PaddedTile tile;
+    tile.fill(src, 0, width, begin_y, end_y, h, h, border);
+
+    const std::vector<int> pairs = TapPairs(k);
+    std::vector<const QRgb*> ptrs(2 * n);
+
+    const SimdLevel level = k.fits16 ? ActiveSimdLevel() : SimdLevel::Scalar;
+
+    for (int j = begin_y; j < end_y; ++j)
+    {
+        for (size_t t = 0; t < n; ++t)
+        {
+            const TapTerm& term = k.terms[t];
+            ptrs[2 * t] = tile.line(j - h + term.y0) - h + term.x0;
+            ptrs[2 * t + 1] = tile.line(j - h + term.y1) - h + term.x1;
+        }
+
+        QRgb* out = dst.line(j);
+
+        int i = 0;
+
+        // пустой список (нулевое ядро) - bias >> shift, как у ConvolveFixed; это скалярный путь
+#if defined(CONVOLVE_X86)
+        if (n > 0 && level == SimdLevel::AVX2)
+            i = RowTapsAVX2(ptrs.data(), out, k, pairs.data(), 0, width);
+        else if (n > 0 && level == SimdLevel::SSE2)
+            i = RowTapsSSE2(ptrs.data(), out, k, pairs.data(), 0, width);
+#else
+        (void)level;
+#endif
+
+        RowTapsScalar(ptrs.data(), out, k, i, width);
+    }
+}
+
+void SeparableRowsPlane(const ConstPlaneView& src, ushort* tmp, const FixedKernel& k, const BorderMode mode,
+                        const uchar edge, const int begin_y, const int end_y)
+{
+    switch (k.ksz)
+    {
+    case 3: SeparableRowsPlaneN<3>(src, tmp, k, mode, edge, begin_y, end_y); break;
+    case 5: SeparableRowsPlaneN<5>(src, tmp, k, mode, edge, begin_y, end_y); break;
+    case 7: SeparableRowsPlaneN<7>(src, tmp, k, mode, edge, begin_y, end_y); break;
+    case 9: SeparableRowsPlaneN<9>(src, tmp, k, mode, edge, begin_y, end_y); break;
+    }
+}
+
+void SeparableColsPlane(const ushort* tmp, const PlaneView& dst, const FixedKernel& k, const BorderMode mode,
+                        const uchar edge, const int begin_y, const int end_y)
+{
+    switch (k.ksz)
+    {
+    case 3: SeparableColsPlaneN<3>(tmp, dst, k, mode, edge, begin_y, end_y); break;
+    case 5: SeparableColsPlaneN<5>(tmp, dst, k, mode, edge, begin_y, end_y); break;
+    case 7: SeparableColsPlaneN<7>(tmp, dst, k, mode, edge, begin_y, end_y); break;
+    case 9: SeparableColsPlaneN<9>(tmp, dst, k, mode, edge, begin_y, end_y); break;
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef CONVOLVE_H
+#define CONVOLVE_H
+
+#include <QImage>
+#include <QRgb>
+
+#include <vector>
+
+#include "border.h"
+#include "imageview.h"
+
+//  Свёртка в целых числах с ядрами, размер которых известен при компиляции (3, 5, 7, 9).
+//  Веса переводятся в фиксированную точку один раз, внутренние циклы по ядру полностью
+//  развёрнуты; для остальных размеров вызывающий код использует общую реализацию.
+
+// Веса w / div, умноженные на 2^shift и округлённые. Двумерное ядро - taps[x * ksz + y]
+// (x - смещение по горизонтали, как у ядра CustomFilter), одномерное - taps[k].
+struct FixedKernel
+{
+    int ksz = 0;
+    int shift = 0;
+    int bias = 0;               // добавляется к сумме перед сдвигом
+    std::vector<int> taps;
+};
+
+// есть ли развёрнутая реализация для такого размера ядра
+bool HasFixedKernel(int ksz);
+
+// Двумерное ядро ksz x ksz. Результат: floor(сумма / div), как у вычисления в double, или на 1
+// больше, если дробная часть точной суммы больше 1 - 255 * ksz^2 / 2^shift (для целых ядер с
+// |div| < 2^shift / (255 * ksz^2) совпадает точно). Сдвиг выбирается наибольшим, при котором
+// сумма помещается в int32, и не меньше log2(255 * ksz^2), так что ошибка никогда не больше 1.
+// false, если такого сдвига нет - тогда нужна общая реализация.
+bool QuantizeKernel(const std::vector<double>& kernel, double div, FixedKernel* out);
+
+// То же с весами в int16 (|вес| <= 32767) для SIMD; сдвиг из-за этого обычно меньше,
+// и точное совпадение с double для целых ядер - только при меньших |div|. Ядро любого размера.
+bool QuantizeKernel16(const std::vector<double>& kernel, double div, FixedKernel* out);
+
+// Одномерное нормированное ядро (сумма 1, веса неотрицательны) для двух проходов:
+// сумма весов ровно 2^14, поэтому однотонные области не меняются.
+FixedKernel QuantizeSeparable(const std::vector<float>& kernel);
+
+// строки [begin_y, end_y) результата свёртки src (dst того же размера); k.ksz - из HasFixedKernel. За краем - по border:
+// полоса вместе с полями копируется один раз (PaddedTile), внутренний цикл проверок не делает
+void ConvolveFixed(const ConstImageView& src, const ImageView& dst, const FixedKernel& k, const Border& border,
+                   int begin_y, int end_y);
+
+// то же для ядра из QuantizeKernel16: пары весов через pmaddwd, 4 (SSE2) или 8 (AVX2) пикселей
+// за итерацию по ActiveSimdLevel; остаток строки - скалярно, с тем же результатом
+void ConvolveFixed16(const ConstImageView& src, const ImageView& dst, const FixedKernel& k, const Border& border,
+                     int begin_y, int end_y);
+
+// Слагаемое TapKernel: вес weight у пикселя со смещением (x0, y0) ядра и, если sign != 0, у
+// отражённого (x1, y1) с весом sign * weight - тогда пиксели складываются (вычитаются) до умножения
+struct TapTerm
+{
+    int x0 = 0;
+    int y0 = 0;
+    int x1 = 0;
+    int y1 = 0;
+    int sign = 0;
+    int weight = 0;
+};
+
+// Ядро из QuantizeKernel или QuantizeKernel16 списком ненулевых слагаемых
+struct TapKernel
+{
+    int ksz = 0;
+    int shift = 0;
+    int bias = 0;
+    bool fits16 = false;        // веса помещаются в int16 - строки считаются в SIMD
+    std::vector<TapTerm> terms;
+
+    // слагаемых с парой (одно умножение на два пикселя)
+    int folded() const;
+};
+
+// Нулевые веса пропускаются, пары с равными или противоположными весами в точках, симметричных
+// относительно центра, горизонтальной или вертикальной оси, сворачиваются в одно слагаемое.
+// Сумма в целых числах та же, что у ConvolveFixed / ConvolveFixed16 с ядром k, результат совпадает.
+TapKernel CompileTaps(const FixedKernel& k);
+
+// строки [begin_y, end_y) свёртки src ядром k (dst того же размера); за краем - по border
+void ConvolveTaps(const ConstImageView& src, const ImageView& dst, const TapKernel& k, const Border& border,
+                  int begin_y, int end_y);
+
+// Два прохода сепарабельного ядра из QuantizeSeparable. tmp - 3 значения на пиксель
+// (R, G, B с 8 дробными битами), width * height * 3 элементов.
+void SeparableRowsFixed(const ConstImageView& src, ushort* tmp, const FixedKernel& k, const Border& border,
+                        int begin_y, int end_y);
+void SeparableColsFixed(const ushort* tmp, const ImageView& dst, const FixedKernel& k, const Border& border,
+                        int begin_y, int end_y);
+
+// то же для одной плоскости PlanarImage: tmp - width * height значений, edge - значение канала
+// за краем для Constant; результат совпадает с соответствующим каналом двух функций выше
+void SeparableRowsPlane(const ConstPlaneView& src, ushort* tmp, const FixedKernel& k, BorderMode mode, uchar edge,
+                        int begin_y, int end_y);
+void SeparableColsPlane(const ushort* tmp, const PlaneView& dst, const FixedKernel& k, BorderMode mode, uchar edge,
+                        int begin_y, int end_y);
+
+#endif // CONVOLVE_H
@@ -0,0 +1,287 @@
+#include "fft.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace {
+
+using Complex = std::complex<double>;
+
+// Запас округления: погрешность double в БПФ могла бы дать на 1 меньше при целом точном значении,
+// поэтому к частному добавляется FftBias (как SeparableBias в imageproc.cpp). Ошибка БПФ - не больше
+// FftRelError * sum |w| / |div| * 255 (с запасом в десятки раз для n <= FftMaxBlock), FftAccurate
+// требует, чтобы это было меньше FftBias.
+constexpr double FftBias = 1e-6;
+constexpr double FftRelError = 1e-13;
+
+constexpr int FftMinBlock = 32;
+constexpr int FftMaxBlock = 512;
+
+// умножение без проверок на inf/nan, которые std::complex делает по стандарту
+inline Complex Mul(const Complex& a, const Complex& b) noexcept
+{
+    return Complex(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+}
+
+inline uchar ToChannel(const double v) noexcept
+{
+    const double x = v + FftBias;
+    return static_cast<uchar>(x <= 0.0 ? 0 : (x >= 255.0 ? 255 : static_cast<int>(x)));
+}
+
+inline int Log2(int n) noexcept
+{
+    int k = 0;
+    while ((1 << k) < n)
+        ++k;
+    return k;
+}
+
+}
+
+Fft2D::Fft2D(const int n) : n(n), rev(n), twiddles(n / 2)
+{
+    const int bits = Log2(n);
+
+    for (int i = 0; i < n; ++i)
+    {
+        int r = 0;
+        for (int b = 0; b < bits; ++b)
+            if (i & (1 << b))
+                r |= 1 << (bits - 1 - b);
+
+        rev[i] = r;
+    }
+
+    const double pi = std::acos(-1.0);
+    for (int k = 0; k < n / 2; ++k)
+        twiddles[k] = std::polar(1.0, -2.0 * pi * k / n);
+}
+
+void Fft2D::transform(Complex* a, const bool inverse) const
+{
+    rows(a, inverse);
+    columns(a, inverse);
+}
+
+void Fft2D::rows(Complex* a, const bool inverse) const
+{
+    for (int j = 0; j < n; ++j)
+    {
+        Complex* row = a + static_cast<size_t>(j) * n;
+
+        for (int i = 0; i < n; ++i)
+            if (i < rev[i])
+                std::swap(row[i], row[rev[i]]);
+
+        for (int len = 2; len <= n; len *= 2)
+        {
+            const int half = len / 2;
+            const int step = n / len;
+
+            for (int i = 0; i < n; i += len)
+            {
+                for (int k = 0; k < half; ++k)
+                {
+                    const Complex w = inverse ? std::conj(twiddles[k * step]) : twiddles[k * step];
+                    const Complex t = Mul(w, row[i + k + half]);
+
+                    row[i + k + half] = row[i + k] - t;
+                    row[i + k] += t;
+                }
+            }
+        }
+    }
+}
+
+// те же бабочки, что в rows, но над целыми строками: внутренний цикл идёт по памяти подряд
+void Fft2D::columns(Complex* a, const bool inverse) const
+{
+    const size_t row_sz = static_cast<size_t>(n);
+
+    for (int j = 0; j < n; ++j)
+        if (j < rev[j])
+            std::swap_ranges(a + j * row_sz, a + (j + 1) * row_sz, a + rev[j] * row_sz);
+
+    for (int len = 2; len <= n; len *= 2)
+    {
+        const int half = len / 2;
+        const int step = n / len;
+
+        for (int j = 0; j < n; j += len)
+        {
+            for (int k = 0; k < half; ++k)
+            {
+                const Complex w = inverse ? std::conj(twiddles[k * step]) : twiddles[k * step];
+                Complex* top = a + (j + k) * row_sz;
+                Complex* bottom = a + (j + k + half) * row_sz;
+
+                for (size_t i = 0; i < row_sz; ++i)
+                {
+                    const Complex t = Mul(w, bottom[i]);
+
+                    bottom[i] = top[i] - t;
+                    top[i] += t;
+                }
+            }
+        }
+    }
+}
+
+double FftCost(const int n, const int ksz, const int width, const int height)
+{
+    // точных пикселей на блок; у узкого изображения блок используется не целиком
+    const double valid = n - ksz + 1;
+    const double used = std::min(valid, static_cast<double>(width)) * std::min(valid, static_cast<double>(height));
+
+    // три канала - полтора комплексных преобразования туда и обратно, в каждом 2 n^2 log2 n бабочек;
+    // бабочка по замерам (2000x1500, n = 64..512) - около 10 умножений 16-битного SIMD пути
+    return 64.0 * n * n * Log2(n) / used;
+}
+
+int FftBlockSize(const int ksz, const int width, const int height)
+{
+    int best = 0;
+    double best_cost = 0.0;
+
+    // блок меньше 2 ksz тратит больше половины на поля
+    for (int n = FftMinBlock; n <= FftMaxBlock; n *= 2)
+    {
+        if (n < 2 * ksz)
+            continue;
+
+        const double cost = FftCost(n, ksz, width, height);
+
+        if (best == 0 || cost < best_cost)
+        {
+            best = n;
+            best_cost = cost;
+        }
+    }
+
+    return best;
+}
+
+bool FftAccurate(const std::vector<double>& kernel, const double div)
+{
+    double abs_sum = 0.0;
+    for (double w : kernel)
+        abs_sum += std::fabs(w);
+
+    return FftRelError * 255.0 * abs_sum < FftBias * std::fabs(div);
+}
+
+std::vector<Complex> KernelSpectrum(const std::vector<double>& kernel, const int ksz, const double div,
+                                    const Fft2D& fft)
+{
+    const int n = fft.size();
+    const double scale = 1.0 / (div * n * n);
+    std::vector<Complex> spectrum(static_cast<size_t>(n) * n);
+
+    // БПФ даёт свёртку, а CustomFilter - корреляцию: ядро отражается, вес (x, y) - в точке
+    // (ksz - 1 - x, ksz - 1 - y), тогда точный результат для пикселя i блока - в точке i + ksz - 1
+    for (int x = 0; x < ksz; ++x)
+        for (int y = 0; y < ksz; ++y)
+            spectrum[static_cast<size_t>(ksz - 1 - y) * n + (ksz - 1 - x)] = kernel[x * ksz + y] * scale;
+
+    fft.transform(spectrum.data(), false);
+    return spectrum;
+}
+
+void ConvolveFft(const ConstImageView& src, const ImageView& dst, const Fft2D& fft,
+                 const std::vector<Complex>& spectrum, const int ksz, const Border& border,
+                 const int begin_y, const int end_y)
+{
+    const int width = src.width();
+    const int n = fft.size();
+    const int r = ksz / 2;
+    const int valid = n - ksz + 1;
+    const size_t block_sz = static_cast<size_t>(n) * n;
+
+    PaddedTile tile;
+    tile.fill(src, 0, width, begin_y, end_y, r, r, border);
+
+    // Блоки идут парами (bx0, bx1): R0 + i G0, B0 + i B1, R1 + i G1 - три преобразования на два блока.
+    // Ядро вещественное, поэтому вещественная и мнимая части свёртки - свёртки каналов по отдельности.
+    std::vector<Complex> z[3];
+    for (auto& buf : z)
+        buf.resize(block_sz);
+
+    auto channel = [](const QRgb p, const int c) -> double {
+        return c == 0 ? qRed(p) : (c == 1 ? qGreen(p) : qBlue(p));
+    };
+
+    // В buf: вещественная часть - канал ca блока с левым краем bxa, мнимая - канал cb блока bxb
+    // (bxb < 0 - нули). В блок n x n попадают rows + 2r строк и cols + 2r столбцов тайла,
+    // остальное - нули: точные точки результата их не читают.
+    auto load = [&](std::vector<Complex>& buf, const int by, const int rows,
+                    const int bxa, const int ca, const int bxb, const int cb) {
+        std::fill(buf.begin(), buf.end(), Complex());
+
+        const int cols_a = std::min(valid, width - bxa) + 2 * r;
+        const int cols_b = bxb < 0 ? 0 : std::min(valid, width - bxb) + 2 * r;
+
+        for (int v = 0; v < rows + 2 * r; ++v)
+        {
+            const QRgb* line = tile.line(by - r + v);
+            Complex* out = buf.data() + static_cast<size_t>(v) * n;
+
+            for (int u = 0; u < cols_a; ++u)
+                out[u].real(channel(line[bxa - r + u], ca));
+
+            for (int u = 0; u < cols_b; ++u)
+                out[u].imag(channel(line[bxb - r + u], cb));
+        }
+    };
+
+    auto convolve = [&](std::vector<Complex>& buf) {
+        fft.transform(buf.data(), false);
+
+        for (size_t k = 0; k < block_sz; ++k)
+            buf[k] = Mul(buf[k], spectrum[k]);
+
+        fft.transform(buf.data(), true);
+    };
+
+    for (int by = begin_y; by < end_y; by += valid)
+    {
+        const int rows = std::min(valid, end_y - by);
+
+        for (int bx0 = 0; bx0 < width; bx0 += 2 * valid)
+        {
+            const int bx1 = bx0 + valid < width ? bx0 + valid : -1;
+
+            load(z[0], by, rows, bx0, 0, bx0, 1);
+            load(z[1], by, rows, bx0, 2, bx1, 2);
+            convolve(z[0]);
+            convolve(z[1]);
+
+            if (bx1 >= 0)
+            {
+                load(z[2], by, rows, bx1, 0, bx1, 1);
+                convolve(z[2]);
+            }
+
+            for (int v = 0; v < rows; ++v)
+            {
+                const size_t at = static_cast<size_t>(v + ksz - 1) * n + ksz - 1;
+                const Complex* rg0 = z[0].data() + at;
+                const Complex* b01 = z[1].data() + at;
+                const Complex* rg1 = z[2].data() + at;
+                QRgb* out = dst.line(by + v);
+
+                const int cols0 = std::min(valid, width - bx0);
+                for (int i = 0; i < cols0; ++i)
+                    out[bx0 + i] = qRgb(ToChannel(rg0[i].real()), ToChannel(rg0[i].imag()), ToChannel(b01[i].real()));
+
+                if (bx1 < 0)
+                    continue;
+
+                const int cols1 = std::min(valid, width - bx1);
+                for (int i = 0; i < cols1; ++i)
+                    out[bx1 + i] = qRgb(ToChannel(rg1[i].real()), ToChannel(rg1[i].imag()), ToChannel(b01[i].imag()));
+            }
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <QImage>
+#include <QRgb>
+
+#include <complex>
+#include <vector>
+
+#include "border.h"
+#include "imageview.h"
+
+//  Свёртка больших ядер через быстрое преобразование Фурье: изображение режется на блоки,
+//  каждый блок вместе с полями ksz / 2 (PaddedTile) переводится в частотную область,
+//  умножается на спектр ядра и переводится обратно - по краям блока результат циклической
+//  свёртки испорчен, центр n - ksz + 1 точный (перекрытие с сохранением). На пиксель
+//  O(log n) операций вместо ksz^2, память - несколько блоков n x n на поток.
+
+// Двумерное БПФ n x n по основанию 2 (n - степень двойки) над комплексными числами.
+// Каналы изображения вещественные, поэтому в одно комплексное преобразование идут
+// два канала сразу: один - вещественной частью, другой - мнимой.
+class Fft2D
+{
+public:
+    explicit Fft2D(int n);
+
+    int size() const { return n; }
+
+    // a - n x n по строкам; обратное преобразование без деления на n^2
+    void transform(std::complex<double>* a, bool inverse) const;
+
+private:
+    int n;
+    std::vector<int> rev;                           // перестановка с обратным порядком бит
+    std::vector<std::complex<double>> twiddles;     // exp(-2 pi i k / n), k < n / 2
+
+    void rows(std::complex<double>* a, bool inverse) const;
+    void columns(std::complex<double>* a, bool inverse) const;
+};
+
+// Размер блока n для ядра ksz x ksz и изображения width x height - с наименьшей оценкой
+// времени на пиксель (FftCost); 0, если ядро больше наибольшего блока.
+int FftBlockSize(int ksz, int width, int height);
+
+// оценка времени на пиксель для блока n в тех же единицах, что у путей CustomFilter (см. imageproc.cpp)
+double FftCost(int n, int ksz, int width, int height);
+
+// Проверка точности: для ядра с sum |w| / |div| больше предела ошибка double в БПФ
+// может превысить запас округления, и результат разошёлся бы со свёрткой в double больше чем на 1.
+bool FftAccurate(const std::vector<double>& kernel, double div);
+
+// Спектр ядра CustomFilter (kernel[x * ksz + y]) для блока fft.size(), делённый на div и n^2.
+std::vector<std::complex<double>> KernelSpectrum(const std::vector<double>& kernel, int ksz, double div,
+                                                 const Fft2D& fft);
+
+// Строки [begin_y, end_y) свёртки src ядром со спектром spectrum (dst того же размера).
+// Результат - floor(сумма / div), как у свёртки в double, или на 1 больше.
+void ConvolveFft(const ConstImageView& src, const ImageView& dst, const Fft2D& fft,
+                 const std::vector<std::complex<double>>& spectrum, int ksz, const Border& border,
+                 int begin_y, int end_y);
+
+#endif // FFT_H
@@ -1,72 +1,159 @@
 #include "imageproc.h"
 
 #include <utility>
-#include <future>
+#include <algorithm>
 #include <cmath>
-
+#include <cstdint>
+#include <limits>
+
+#include "convolve.h"
+#include "fft.h"
+#include "opgraph.h"
+#include "pointops.h"
+#include "svd.h"
+#include "threadpool.h"
 #include "timer.h"
 
-template<typename F, typename... Args>
-void ForEachPixel(MyColorIterator first, MyColorIterator last, F func, Args&&... args)
+// высота полосы строк для пула: результат полосы занимает порядка 256 КБ (помещается в L2),
+// но не меньше min_rows строк
+inline int BandRows(const int width, const int min_rows = 8)
+{
+    return max(min_rows, (256 * 1024) / (4 * max(width, 1)));
+}
+
+// то же для плоскости PlanarImage: байт на пиксель, а не 4
+inline int PlaneBandRows(const int width, const int min_rows = 8)
+{
+    return BandRows((width + 3) / 4, min_rows);
+}
+
+// f(QRgb* pixels, size_t count) для всех пикселей; строки без выравнивания обрабатываются одним куском
+template<typename F>
+void ForEachLine(const ImageView& view, F func)
 {
-    while(first != last)
+    const int width = view.width();
+    const int height = view.height();
+
+    if (view.contiguous())
     {
-        *first = func(*first, std::forward<Args>(args)...);
-        ++first;
+        func(view.line(0), static_cast<size_t>(width) * height);
+        return;
     }
+
+    for (int j = 0; j < height; ++j)
+        func(view.line(j), static_cast<size_t>(width));
 }
 
-tuple<pair<uchar, uchar>, pair<uchar, uchar>, pair<uchar, uchar>> MinMaxColor(ConstMyColorIterator first, ConstMyColorIterator last)
+// гистограммы строк [begin_y, end_y). По 4 копии на канал, чтобы соседние пиксели
+// с одинаковым значением не упирались в один и тот же счётчик
+void HistogramLoop(const ConstImageView& src, array<array<int, 256>, 3>& hist, const int begin_y, const int end_y)
 {
-    uchar red = first.red();
-    uchar green = first.green();
-    uchar blue = first.blue();
+    const int width = src.width();
+
+    vector<int> h(4 * 3 * 256, 0);
+    int* h0 = h.data();
+    int* h1 = h0 + 3 * 256;
+    int* h2 = h1 + 3 * 256;
+    int* h3 = h2 + 3 * 256;
+
+    auto count = [](int* hp, const QRgb c){
+        ++hp[qRed(c)];
+        ++hp[256 + qGreen(c)];
+        ++hp[512 + qBlue(c)];
+    };
 
-    pair<uchar, uchar> R = make_pair(red, red);
-    pair<uchar, uchar> G = make_pair(green, green);
-    pair<uchar, uchar> B = make_pair(blue, blue);
+    for (int j = begin_y; j < end_y; ++j)
+    {
+        const QRgb* line = src.line(j);
+
+        int i = 0;
+        for (; i + 4 <= width; i += 4)
+        {
+            count(h0, line[i]);
+            count(h1, line[i + 1]);
+            count(h2, line[i + 2]);
+            count(h3, line[i + 3]);
+        }
 
-    ++first;
+        for (; i < width; ++i)
+            count(h0, line[i]);
+    }
 
-    auto comp = [](uchar a, pair<uchar, uchar>& b){
-      if(a < b.first)
-          b.first = a;
-      else if(a > b.second)
-          b.second = a;
-    };
+    for (int ch = 0; ch < 3; ++ch)
+        for (int v = 0; v < 256; ++v)
+            hist[ch][v] = h0[ch * 256 + v] + h1[ch * 256 + v] + h2[ch * 256 + v] + h3[ch * 256 + v];
+}
 
-    while(first != last)
+// min, max и суммы однозначно выводятся из гистограмм
+void DeriveStats(ImageStats& st)
+{
+    for (int ch = 0; ch < 3; ++ch)
     {
-        red = first.red();
-        green = first.green();
-        blue = first.blue();
+        const auto& hist = st.hist[ch];
+
+        ull count = 0;
+        ull sum = 0;
+        for (int v = 0; v < 256; ++v)
+        {
+            count += hist[v];
+            sum += static_cast<ull>(hist[v]) * v;
+        }
+
+        int lo = 0;
+        while (lo < 255 && hist[lo] == 0)
+            ++lo;
 
-        comp(red, R);
-        comp(green, G);
-        comp(blue, B);
+        int hi = 255;
+        while (hi > 0 && hist[hi] == 0)
+            --hi;
 
-        ++first;
+        st.min[ch] = static_cast<uchar>(lo);
+        st.max[ch] = static_cast<uchar>(hi);
+        st.sum[ch] = sum;
+        st.count = count;
     }
+}
+
+ImageStats ComputeStats(const ConstImageView& src)
+{
+    const int height = src.height();
+
+    ImageStats st;
+    for (auto& h : st.hist)
+        h.fill(0);
+
+    mutex merge;
 
-    return make_tuple(R, G, B);
+    ThreadPool::Instance().ParallelFor(0, height, BandRows(src.width(), 16), [&](int begin_y, int end_y){
+        array<array<int, 256>, 3> part;
+        HistogramLoop(src, part, begin_y, end_y);
+
+        lock_guard<mutex> lock(merge);
+        for (int ch = 0; ch < 3; ++ch)
+            for (int v = 0; v < 256; ++v)
+                st.hist[ch][v] += part[ch][v];
+    });
+
+    DeriveStats(st);
+
+    return st;
 }
 
-tuple<ull, ull, ull> ColorSum(ConstMyColorIterator first, ConstMyColorIterator last)
+ImageStats RemapStats(const ImageStats& st, const ToneLut& lut)
 {
-    ull R = 0;
-    ull G = 0;
-    ull B = 0;
+    ImageStats out;
 
-    while(first != last)
+    for (int ch = 0; ch < 3; ++ch)
     {
-        R += first.red();
-        G += first.green();
-        B += first.blue();
+        out.hist[ch].fill(0);
 
-        ++first;
+        for (int v = 0; v < 256; ++v)
+            out.hist[ch][lut[ch][v]] += st.hist[ch][v];
     }
 
-    return make_tuple(R, G, B);
+    DeriveStats(out);
+
+    return out;
 }
 
 inline Uint8 ovfctrl(const int x) noexcept
@@ -76,14 +163,6 @@ inline Uint8 ovfctrl(const int x) noexcept
     return x;
 }
 
-inline int b_ctrl(int& x, const int max) noexcept
-{
-    if(x < 0)		return x = x * (-1) - 1;
-    if(x >= max)	return x = max - (x - (max - 1));
-
-    return x;
-}
-
 Uint8 find_median(Matrix<Uint8>& m, array<int, 256>& hist, bool ns)
 {
     int ksz = m.size_dim1();
@@ -118,594 +197,1542 @@ Uint8 find_median(Matrix<Uint8>& m, array<int, 256>& hist, bool ns)
     return result;
 }
 
-Uint8 find_min(Matrix<Uint8>& m, array<int, 256>& hist, bool ns)
+// окно ksz x ksz вокруг (i, j); поля tile уже заполнены, поэтому проверок границ нет
+void fillTmpMatrix(Matrix<Uint8>& red, Matrix<Uint8>& green, Matrix<Uint8>& blue, const PaddedTile& tile, const int ksz, const int i, const int j)
 {
-    int ksz = m.size_dim1();
+    const int ksz_2 = ksz / 2;
 
-    if (ns)
+    for (int x = 0; x < ksz; x++)
     {
-        hist.fill(0);
+        const int posPixX = i - ksz_2 + x;
 
-        for (const auto i : m)
-            ++hist[i];
+        Uint8* r = red[x];
+        Uint8* g = green[x];
+        Uint8* b = blue[x];
+
+        for (int y = 0; y < ksz; y++)
+        {
+            const QRgb tmpc = tile.at(posPixX, j - ksz_2 + y);
+
+            r[y] = qRed(tmpc);
+            g[y] = qGreen(tmpc);
+            b[y] = qBlue(tmpc);
+        }
     }
-    else {
-        for (int i = 0; i < ksz; i++)
-            ++hist[m[i][ksz - 1]];
+}
+
+
+// Общее ядро свёртки: src только читается, результат пишется в строки [begin_y, end_y) dst.
+// kernel[x * ksz + y] - вес пикселя со смещением (x - ksz/2, y - ksz/2), как в fillTmpMatrix
+void ConvolveLoop(const ConstImageView& src, const ImageView& dst, const vector<double>* kernel, const int ksz, const double div,
+                  const Border& border, const int begin_y, const int end_y)
+{
+    const int width = src.width();
+    const int ksz_2 = ksz / 2;
+
+    PaddedTile tile;
+    tile.fill(src, 0, width, begin_y, end_y, ksz_2, ksz_2, border);
+
+    vector<const QRgb*> lines(ksz);
+
+    for (int j = begin_y; j < end_y; ++j)
+    {
+        for (int y = 0; y < ksz; ++y)
+            lines[y] = tile.line(j - ksz_2 + y);
+
+        QRgb* out = dst.line(j);
+
+        for (int i = 0; i < width; ++i)
+        {
+            double r = 0.0;
+            double g = 0.0;
+            double b = 0.0;
+
+            const double* w = kernel->data();
+
+            for (int x = 0; x < ksz; ++x)
+            {
+                const int pos = i - ksz_2 + x;
+
+                for (int y = 0; y < ksz; ++y, ++w)
+                {
+                    const QRgb c = lines[y][pos];
+
+                    r += *w * qRed(c);
+                    g += *w * qGreen(c);
+                    b += *w * qBlue(c);
+                }
+            }
+
+            out[i] = qRgb(ovfctrl(static_cast<int>(r / div)),
+                          ovfctrl(static_cast<int>(g / div)),
+                          ovfctrl(static_cast<int>(b / div)));
+        }
     }
+}
 
-    Uint8 result = 0;
+// Среднее по окну kw x kh через таблицу сумм (summed-area table) тайла полосы: сумма окна -
+// четыре обращения к таблице при любом размере окна. Суммы 32-битные по модулю 2^32: разность
+// четырёх элементов верна, пока сама сумма окна (не больше 255 * kw * kh) меньше 2^32.
+// Частное - точное floor(sum / n), деление заменено умножением на ceil(2^48 / n)
+// (точно при 255 * n^2 < 2^48, т.е. для окон до 1024 x 1024; больше - обычное деление).
+void BoxFilterLoop(const ConstImageView& src, const ImageView& dst, const int kw, const int kh,
+                   const Border& border, const int begin_y, const int end_y)
+{
+    const int width = src.width();
+    const int rx = kw / 2;
+    const int ry = kh / 2;
+
+    PaddedTile tile;
+    tile.fill(src, 0, width, begin_y, end_y, rx, ry, border);
+
+    // элемент (y, x) - суммы R, G, B тайла выше строки y и левее столбца x; строка и столбец 0 нулевые
+    const int cols = width + 2 * rx + 1;
+    const int rows = end_y - begin_y + 2 * ry + 1;
+    const size_t row_step = 3 * static_cast<size_t>(cols);
 
-    for(int i = 0; i < 256; i++)
+    vector<uint32_t> sat(row_step * rows);
+    fill(sat.begin(), sat.begin() + row_step, 0u);
+
+    for (int y = 1; y < rows; ++y)
     {
-        if(hist[i] != 0){
-            result = i;
-            break;
+        const QRgb* in = tile.line(begin_y - ry + y - 1) - rx;
+        const uint32_t* above = sat.data() + (y - 1) * row_step;
+        uint32_t* row = sat.data() + y * row_step;
+
+        uint32_t r = 0;
+        uint32_t g = 0;
+        uint32_t b = 0;
+
+        row[0] = row[1] = row[2] = 0;
+
+        for (int x = 1; x < cols; ++x)
+        {
+            const QRgb c = in[x - 1];
+
+            r += qRed(c);
+            g += qGreen(c);
+            b += qBlue(c);
+
+            row[3 * x] = above[3 * x] + r;
+            row[3 * x + 1] = above[3 * x + 1] + g;
+            row[3 * x + 2] = above[3 * x + 2] + b;
         }
     }
 
-    for (int i = 0; i < ksz; i++)
-        --hist[m[i][0]];
+    const uint64_t n = static_cast<uint64_t>(kw) * kh;
+    const uint64_t m = ((uint64_t(1) << 48) + n - 1) / n;
+    const bool exact_mul = n < (1u << 20);
 
-    return result;
+    for (int j = begin_y; j < end_y; ++j)
+    {
+        const uint32_t* top = sat.data() + (j - begin_y) * row_step;
+        const uint32_t* bottom = top + kh * row_step;
+        QRgb* out = dst.line(j);
+
+        for (int i = 0; i < width; ++i)
+        {
+            const int left = 3 * i;
+            const int right = 3 * (i + kw);
+
+            uint32_t sum[3];
+            for (int c = 0; c < 3; ++c)
+                sum[c] = bottom[right + c] - bottom[left + c] - top[right + c] + top[left + c];
+
+            if (exact_mul)
+                out[i] = qRgb(static_cast<int>((sum[0] * m) >> 48),
+                              static_cast<int>((sum[1] * m) >> 48),
+                              static_cast<int>((sum[2] * m) >> 48));
+            else
+                out[i] = qRgb(static_cast<int>(sum[0] / n), static_cast<int>(sum[1] / n), static_cast<int>(sum[2] / n));
+        }
+    }
 }
 
-Uint8 find_max(Matrix<Uint8>& m, array<int, 256>& hist, bool ns)
+// Свёртка ядром, разложенным в сумму сепарабельных слагаемых (DecomposeKernel). Строки тайла
+// полосы с полями идут по одной: строка распаковывается в double, горизонтальный проход каждого
+// слагаемого пишется в его кольцо из ksz строк, и как только в кольцах есть ksz строк - вертикальный
+// проход даёт строку результата. На пиксель - 2 * ksz умножений на слагаемое вместо ksz^2.
+// Частное - как у ConvolveLoop; погрешность double и отброшенного остатка ядра могла бы дать на 1
+// меньше при целом точном значении, поэтому к нему добавляется SeparableBias: результат не меньше,
+// чем в ConvolveLoop, и не больше чем на 1 (как у путей в целых числах).
+constexpr double SeparableBias = 1e-7;
+
+void ConvolveSeparableLoop(const ConstImageView& src, const ImageView& dst, const vector<SeparableTerm>& terms,
+                           const int ksz, const double div, const Border& border, const int begin_y, const int end_y)
 {
-    int ksz = m.size_dim1();
+    const int width = src.width();
+    const int r = ksz / 2;
+    const int tile_rows = end_y - begin_y + 2 * r;
+    const size_t row_sz = 3 * static_cast<size_t>(width);
+    const size_t rank = terms.size();
 
-    if (ns)
+    PaddedTile tile;
+    tile.fill(src, 0, width, begin_y, end_y, r, r, border);
+
+    vector<double> pix(3 * static_cast<size_t>(width + 2 * r));
+    vector<double> rings(rank * ksz * row_sz);
+    vector<double> acc(row_sz);
+
+    for (int t = 0; t < tile_rows; ++t)
     {
-        hist.fill(0);
+        const QRgb* line = tile.line(begin_y - r + t) - r;
 
-        for (const auto i : m)
-            ++hist[i];
+        for (int i = 0; i < width + 2 * r; ++i)
+        {
+            pix[3 * i] = qRed(line[i]);
+            pix[3 * i + 1] = qGreen(line[i]);
+            pix[3 * i + 2] = qBlue(line[i]);
+        }
+
+        for (size_t q = 0; q < rank; ++q)
+        {
+            const vector<double>& h = terms[q].h;
+            double* out = rings.data() + (q * ksz + t % ksz) * row_sz;
+
+            for (size_t k = 0; k < row_sz; ++k)
+                out[k] = h[0] * pix[k];
+
+            for (int x = 1; x < ksz; ++x)
+            {
+                const double w = h[x];
+                const double* in = pix.data() + 3 * x;
+
+                for (size_t k = 0; k < row_sz; ++k)
+                    out[k] += w * in[k];
+            }
+        }
+
+        // строка результата j готова, когда прочитана строка тайла j + 2r
+        if (t < 2 * r)
+            continue;
+
+        const int j = t - 2 * r;
+        fill(acc.begin(), acc.end(), 0.0);
+
+        for (size_t q = 0; q < rank; ++q)
+        {
+            for (int y = 0; y < ksz; ++y)
+            {
+                const double w = terms[q].v[y];
+                const double* in = rings.data() + (q * ksz + (j + y) % ksz) * row_sz;
+
+                for (size_t k = 0; k < row_sz; ++k)
+                    acc[k] += w * in[k];
+            }
+        }
+
+        QRgb* out = dst.line(begin_y + j);
+
+        for (int i = 0; i < width; ++i)
+        {
+            out[i] = qRgb(ovfctrl(static_cast<int>(acc[3 * i] / div + SeparableBias)),
+                          ovfctrl(static_cast<int>(acc[3 * i + 1] / div + SeparableBias)),
+                          ovfctrl(static_cast<int>(acc[3 * i + 2] / div + SeparableBias)));
+        }
     }
-    else {
-        for (int i = 0; i < ksz; i++)
-            ++hist[m[i][ksz - 1]];
+}
+
+// Оценка времени на пиксель в долях одного умножения 16-битного SIMD пути (замеры 2000x1500):
+// плотная свёртка - Fixed16Cost * ksz^2 (Fixed16) или DenseCost * ksz^2 (Fixed, double);
+// сепарабельная - SeparableTileCost на распаковку плюс SeparableTermCost(ksz) на слагаемое;
+// блочная через БПФ - FftCost (fft.cpp); список ненулевых слагаемых - TapsCost.
+constexpr int Fixed16Cost = 1;
+constexpr int DenseCost = 13;
+constexpr int SeparableTileCost = 110;
+
+inline int SeparableTermCost(const int ksz)
+{
+    return 24 * ksz + 36;
+}
+
+// список слагаемых ConvolveTaps: в SIMD - Fixed16Cost на слагаемое, скалярно - TapBaseCost на пиксель
+// и TapTermCost на слагаемое; свёрнутая пара - ещё половина слагаемого
+constexpr int TapBaseCost = 70;
+constexpr int TapTermCost = 18;
+
+double TapsCost(const TapKernel& k)
+{
+    const double terms = k.terms.size() + 0.5 * k.folded();
+
+    if (k.fits16 && ActiveSimdLevel() != SimdLevel::Scalar)
+        return Fixed16Cost * terms;
+
+    return TapBaseCost + TapTermCost * terms;
+}
+
+// наибольший ранг ядра ksz x ksz, при котором сепарабельные проходы дешевле cost
+int SeparableMaxRank(const int ksz, const double cost)
+{
+    const int rank = static_cast<int>((cost - SeparableTileCost) / SeparableTermCost(ksz));
+    return max(0, min(rank, ksz));
+}
+
+// все веса равны и не нулевые - ядро усредняющее, его считает BoxFilter
+bool IsUniformKernel(const vector<double>& kernel)
+{
+    return !kernel.empty() && kernel[0] != 0.0
+            && all_of(kernel.cbegin(), kernel.cend(), [&kernel](double w){ return w == kernel[0]; });
+}
+
+
+ImageProc::ImageProc(QObject *parent):QObject(parent) {}
+
+void ImageProc::SetBorder(const BorderMode mode, const QRgb constant)
+{
+    border.mode = mode;
+    border.constant = constant;
+}
+
+void ImageProc::SetInputTone(const ToneLut* lut)
+{
+    border.tone = lut;
+}
+
+QImage& ImageProc::Target(const QImage* img)
+{
+    return Target(img->size());
+}
+
+QImage& ImageProc::Target(const QSize& size)
+{
+    if(target.size() != size || target.format() != QImage::Format_RGB32 || !target.isDetached())
+        target = QImage(size, QImage::Format_RGB32);
+
+    return target;
+}
+
+void ImageProc::Commit(QImage* img)
+{
+    img->swap(target);
+}
+
+PlanarImage& ImageProc::Target(const PlanarImage& img)
+{
+    planar_target.resize(img.width(), img.height());
+    return planar_target;
+}
+
+void ImageProc::Commit(PlanarImage* img)
+{
+    img->swap(planar_target);
+}
+
+// Поворот на 90° - транспонирование с отражением. Обход блоками RotateTile x RotateTile пикселей:
+// строки блока источника и результата (по 64 байта) одновременно остаются в L1,
+// вместо промаха кэша на каждую запись при обходе по столбцам.
+constexpr int RotateTile = 16;
+
+// строки результата [begin_y, end_y); clockwise: результат (x, y) = источник (y, h - 1 - x),
+// иначе результат (x, y) = источник (w - 1 - y, x)
+void RotateLoop(const ConstImageView& src, const ImageView& dst, const bool clockwise, const int begin_y, const int end_y)
+{
+    const int width = src.width();
+    const int height = src.height();
+
+    for (int y0 = begin_y; y0 < end_y; y0 += RotateTile)
+    {
+        const int y1 = min(y0 + RotateTile, end_y);
+
+        for (int x0 = 0; x0 < height; x0 += RotateTile)
+        {
+            const int x1 = min(x0 + RotateTile, height);
+
+            for (int y = y0; y < y1; ++y)
+            {
+                QRgb* out = dst.line(y);
+                const int sx = clockwise ? y : width - 1 - y;
+
+                for (int x = x0; x < x1; ++x)
+                {
+                    const int sy = clockwise ? height - 1 - x : x;
+                    out[x] = src.at(sx, sy);
+                }
+            }
+        }
     }
+}
 
-    Uint8 result = 0;
+void ImageProc::Rotate(QImage* img, const bool clockwise)
+{
+    if(img->isNull())
+        return;
+
+    const int width = img->width();
+    const int height = img->height();
+
+    const ConstImageView src = ViewOf(*img);
+    const ImageView dst = MutableViewOf(Target(QSize(height, width)));
+
+    // куски кратны блоку, чтобы блоки не резались на границах кусков
+    const int band = max(RotateTile, BandRows(height) / RotateTile * RotateTile);
+
+    ParallelFor(running, 0, width, band, [&](int begin_y, int end_y){
+        RotateLoop(src, dst, clockwise, begin_y, end_y);
+    });
+
+    Commit(img);
+}
+
+void ImageProc::rotate_left(QImage *img)
+{
+    Rotate(img, false);
+}
+
+void ImageProc::rotate_right(QImage *img)
+{
+    Rotate(img, true);
+}
 
-    for(int i = 255; i >= 0; i--)
+// поворот на 180° - строки в обратном порядке, пиксели в строке тоже; обе стороны читаются подряд
+void ImageProc::rotate_180(QImage *img)
+{
+    if(img->isNull())
+        return;
+
+    const int width = img->width();
+    const int height = img->height();
+
+    const ConstImageView src = ViewOf(*img);
+    const ImageView dst = MutableViewOf(Target(img));
+
+    ParallelFor(running, 0, height, BandRows(width), [&](int begin_y, int end_y){
+        for (int j = begin_y; j < end_y; ++j)
+        {
+            const QRgb* line = src.line(height - 1 - j);
+            QRgb* out = dst.line(j);
+
+            reverse_copy(line, line + width, out);
+        }
+    });
+
+    Commit(img);
+}
+
+ImageStats ImageProc::Stats(const QImage* img)
+{
+    lock_guard<mutex> lock(stats_mutex);
+
+    const qint64 key = img->cacheKey();
+
+    if (!stats_valid || stats_key != key)
     {
-        if(hist[i] != 0){
-            result = i;
-            break;
+        stats = ComputeStats(ViewOf(*img));
+        stats_key = key;
+        stats_valid = true;
+    }
+
+    return stats;
+}
+
+void ImageProc::ApplyTone(QImage* img, const ToneLut& lut)
+{
+    if(img->isNull() || lut.isIdentity())
+        return;
+
+    const qint64 key = img->cacheKey();
+
+    // изменение на месте: если данные разделяемые, здесь они один раз отсоединяются
+    const ImageView view = MutableViewOf(*img);
+
+    ParallelFor(running, 0, view.height(), BandRows(view.width(), 16), [&](int begin_y, int end_y){
+        ForEachLine(view.rows(begin_y, end_y), [&lut](QRgb* pixels, size_t count){
+            lut.apply(pixels, count);
+        });
+    });
+
+    // статистика результата известна заранее, если была известна статистика источника
+    lock_guard<mutex> lock(stats_mutex);
+
+    if (stats_valid && stats_key == key)
+    {
+        stats = RemapStats(stats, lut);
+        stats_key = img->cacheKey();
+    }
+}
+
+ToneLut LinearCorrTone(const ImageStats& st)
+{
+    return ToneLut::Stretch(st.min, st.max);
+}
+
+ToneLut GrayWorldTone(const ImageStats& st)
+{
+    const double countPixels = static_cast<double>(st.count);
+
+    const double avgR = st.sum[0] / countPixels;
+    const double avgG = st.sum[1] / countPixels;
+    const double avgB = st.sum[2] / countPixels;
+
+    const double avgAll = (avgR + avgG + avgB) / 3.0;
+
+    const array<float, 3> scale = {
+        static_cast<float>(avgAll / avgR),
+        static_cast<float>(avgAll / avgG),
+        static_cast<float>(avgAll / avgB)
+    };
+    const array<float, 3> offset = { 0.0f, 0.0f, 0.0f };
+
+    return ToneLut::Affine(scale, offset);
+}
+
+void ImageProc::LinearCorr(QImage* img)
+{
+    if(img->isNull())
+        return;
+
+    ApplyTone(img, LinearCorrTone(Stats(img)));
+}
+
+void ImageProc::GrayWorld(QImage* img)
+{
+    if(img->isNull())
+        return;
+
+    ApplyTone(img, GrayWorldTone(Stats(img)));
+}
+
+void ImageProc::GammaFunc(QImage* img, double c, double d)
+{
+    if(img->isNull())
+        return;
+
+    ApplyTone(img, ToneLut::Gamma(c, d));
+}
+
+// нормированное одномерное ядро Гаусса, радиус = 3 sigma
+vector<float> GaussKernel(const double sigma)
+{
+    const int radius = static_cast<int>(ceil(3.0 * sigma));
+
+    vector<float> kernel(2 * radius + 1);
+
+    double sum = 0.0;
+    for (int k = -radius; k <= radius; ++k)
+    {
+        const double w = exp(-(k * k) / (2.0 * sigma * sigma));
+        kernel[k + radius] = static_cast<float>(w);
+        sum += w;
+    }
+
+    for (auto& w : kernel)
+        w = static_cast<float>(w / sum);
+
+    return kernel;
+}
+
+// горизонтальный проход: строки [begin_y, end_y) -> tmp (R, G, B на пиксель)
+void GaussBlurRows(const ConstImageView& src, vector<float>& tmp, const vector<float>& kernel, const Border& border,
+                   const int begin_y, const int end_y)
+{
+    const int width = src.width();
+    const int radius = static_cast<int>(kernel.size() / 2);
+
+    PaddedTile tile;
+    tile.fill(src, 0, width, begin_y, end_y, radius, 0, border);
+
+    for (int j = begin_y; j < end_y; ++j)
+    {
+        const QRgb* line = tile.line(j);
+        float* out = tmp.data() + 3 * static_cast<size_t>(j) * width;
+
+        for (int i = 0; i < width; ++i)
+        {
+            float r = 0.0f;
+            float g = 0.0f;
+            float b = 0.0f;
+
+            for (int k = -radius; k <= radius; ++k)
+            {
+                const QRgb c = line[i + k];
+                const float w = kernel[k + radius];
+
+                r += w * qRed(c);
+                g += w * qGreen(c);
+                b += w * qBlue(c);
+            }
+
+            out[3 * i] = r;
+            out[3 * i + 1] = g;
+            out[3 * i + 2] = b;
         }
     }
+}
 
-    for (int i = 0; i < ksz; i++)
-        --hist[m[i][0]];
+// вертикальный проход: tmp -> строки [begin_y, end_y) результата
+void GaussBlurCols(const vector<float>& tmp, const ImageView& dst, const vector<float>& kernel, const Border& border,
+                   const int begin_y, const int end_y)
+{
+    const int width = dst.width();
+    const int height = dst.height();
+    const int radius = static_cast<int>(kernel.size() / 2);
+    const size_t row_sz = 3 * static_cast<size_t>(width);
 
-    return result;
+    vector<float> acc(row_sz);
+
+    // строки за краем берутся целиком из tmp; для Constant - строка постоянного цвета
+    vector<float> constant;
+    if (border.mode == BorderMode::Constant)
+    {
+        constant.resize(row_sz);
+        for (size_t x = 0; x < row_sz; x += 3)
+        {
+            constant[x] = qRed(border.constant);
+            constant[x + 1] = qGreen(border.constant);
+            constant[x + 2] = qBlue(border.constant);
+        }
+    }
+
+    for (int j = begin_y; j < end_y; ++j)
+    {
+        fill(acc.begin(), acc.end(), 0.0f);
+
+        for (int k = -radius; k <= radius; ++k)
+        {
+            const int pos = BorderIndex(j + k, height, border.mode);
+
+            const float* in = pos < 0 ? constant.data() : tmp.data() + pos * row_sz;
+            const float w = kernel[k + radius];
+
+            for (size_t x = 0; x < row_sz; ++x)
+                acc[x] += w * in[x];
+        }
+
+        QRgb* line = dst.line(j);
+
+        for (int i = 0; i < width; ++i)
+        {
+            line[i] = qRgb(ovfctrl(static_cast<int>(acc[3 * i] + 0.5f)),
+                           ovfctrl(static_cast<int>(acc[3 * i + 1] + 0.5f)),
+                           ovfctrl(static_cast<int>(acc[3 * i + 2] + 0.5f)));
+        }
+    }
+}
+
+// те же проходы по одной плоскости: tmp - width * height значений, edge - значение канала за краем
+void GaussPlaneRows(const ConstPlaneView& src, float* tmp, const vector<float>& kernel, const BorderMode mode,
+                    const uchar edge, const int begin_y, const int end_y)
+{
+    const int width = src.width();
+    const int radius = static_cast<int>(kernel.size() / 2);
+
+    PlaneTile tile;
+    tile.fill(src, 0, width, begin_y, end_y, radius, 0, mode, edge);
+
+    for (int j = begin_y; j < end_y; ++j)
+    {
+        const uchar* line = tile.line(j);
+        float* out = tmp + static_cast<size_t>(j) * width;
+
+        for (int i = 0; i < width; ++i)
+        {
+            float a = 0.0f;
+
+            for (int k = -radius; k <= radius; ++k)
+                a += kernel[k + radius] * line[i + k];
+
+            out[i] = a;
+        }
+    }
 }
 
-void fillTmpMatrix(Matrix<Uint8>& red, Matrix<Uint8>& green, Matrix<Uint8>& blue, const QImage* img, const int ksz, const int i, const int j)
+void GaussPlaneCols(const float* tmp, const PlaneView& dst, const vector<float>& kernel, const BorderMode mode,
+                    const uchar edge, const int begin_y, const int end_y)
 {
+    const int width = dst.width();
+    const int height = dst.height();
+    const int radius = static_cast<int>(kernel.size() / 2);
+
+    vector<float> acc(width);
+
+    vector<float> constant;
+    if (mode == BorderMode::Constant)
+        constant.assign(width, static_cast<float>(edge));
+
+    for (int j = begin_y; j < end_y; ++j)
+    {
+        fill(acc.begin(), acc.end(), 0.0f);
+
+        for (int k = -radius; k <= radius; ++k)
+        {
+            const int pos = BorderIndex(j + k, height, mode);
+
+            const float* in = pos < 0 ? constant.data() : tmp + static_cast<size_t>(pos) * width;
+            const float w = kernel[k + radius];
+
+            for (int x = 0; x < width; ++x)
+                acc[x] += w * in[x];
+        }
+
+        uchar* line = dst.line(j);
+
+        for (int i = 0; i < width; ++i)
+            line[i] = ovfctrl(static_cast<int>(acc[i] + 0.5f));
+    }
+}
+
+void ImageProc::GaussBlur(QImage* img, const double sigma)
+{
+    if(img->isNull() || sigma <= 0.0)
+        return;
+
     const int width = img->width();
     const int height = img->height();
-    const int ksz_2 = ksz / 2;
 
-    for (int x = 0; x < ksz; x++)
+    const vector<float> kernel = GaussKernel(sigma);
+    const int ksz = static_cast<int>(kernel.size());
+
+    const int band = BandRows(width);
+
+    const ConstImageView src = ViewOf(*img);
+
+    // небольшие ядра (sigma до 4/3) - развёрнутые проходы в целых числах
+    if (HasFixedKernel(ksz))
     {
-        for (int y = 0; y < ksz; y++)
+        const FixedKernel fixed = QuantizeSeparable(kernel);
+
+        vector<ushort>& tmp = scratch16;
+        tmp.resize(3 * static_cast<size_t>(width) * height);
+
+        ParallelFor(running, 0, height, band, [&](int begin_y, int end_y){
+            SeparableRowsFixed(src, tmp.data(), fixed, border, begin_y, end_y);
+        });
+
+        const ImageView dst = MutableViewOf(Target(img));
+
+        ParallelFor(running, 0, height, band, [&](int begin_y, int end_y){
+            SeparableColsFixed(tmp.data(), dst, fixed, border, begin_y, end_y);
+        });
+
+        Commit(img);
+        return;
+    }
+
+    vector<float>& tmp = scratch;
+    tmp.resize(3 * static_cast<size_t>(width) * height);
+
+    ParallelFor(running, 0, height, band, [&](int begin_y, int end_y){
+        GaussBlurRows(src, tmp, kernel, border, begin_y, end_y);
+    });
+
+    const ImageView dst = MutableViewOf(Target(img));
+
+    ParallelFor(running, 0, height, band, [&](int begin_y, int end_y){
+        GaussBlurCols(tmp, dst, kernel, border, begin_y, end_y);
+    });
+
+    Commit(img);
+}
+
+void ImageProc::GaussBlur(PlanarImage* img, const double sigma)
+{
+    if(img->isNull() || sigma <= 0.0)
+        return;
+
+    const int width = img->width();
+    const int height = img->height();
+
+    const vector<float> kernel = GaussKernel(sigma);
+    const int ksz = static_cast<int>(kernel.size());
+
+    const int band = PlaneBandRows(width);
+
+    const bool fixed_path = HasFixedKernel(ksz);
+    const FixedKernel fixed = fixed_path ? QuantizeSeparable(kernel) : FixedKernel();
+
+    const size_t plane_sz = static_cast<size_t>(width) * height;
+    if (fixed_path)
+        scratch16.resize(plane_sz);
+    else
+        scratch.resize(plane_sz);
+
+    PlanarImage& out = Target(*img);
+
+    for (int c = 0; c < PlanarImage::Planes; ++c)
+    {
+        const ConstPlaneView src = img->plane(c);
+        const PlaneView dst = out.plane(c);
+        const uchar edge = PlanarImage::channel(border.constant, c);
+
+        if (fixed_path)
+        {
+            ParallelFor(running, 0, height, band, [&](int begin_y, int end_y){
+                SeparableRowsPlane(src, scratch16.data(), fixed, border.mode, edge, begin_y, end_y);
+            });
+            ParallelFor(running, 0, height, band, [&](int begin_y, int end_y){
+                SeparableColsPlane(scratch16.data(), dst, fixed, border.mode, edge, begin_y, end_y);
+            });
+        }
+        else {
+            ParallelFor(running, 0, height, band, [&](int begin_y, int end_y){
+                GaussPlaneRows(src, scratch.data(), kernel, border.mode, edge, begin_y, end_y);
+            });
+            ParallelFor(running, 0, height, band, [&](int begin_y, int end_y){
+                GaussPlaneCols(scratch.data(), dst, kernel, border.mode, edge, begin_y, end_y);
+            });
+        }
+    }
+
+    Commit(img);
+}
+
+void MedianFilterLoop(const ConstImageView& src, const ImageView& dst, const int ksz, const Border& border,
+                      const int begin_x, const int begin_y, const int end_x, const int end_y)
+{
+    PaddedTile tile;
+    tile.fill(src, begin_x, end_x, begin_y, end_y, ksz / 2, ksz / 2, border);
+
+    Matrix<Uint8> part_r(ksz, ksz);
+    Matrix<Uint8> part_g(ksz, ksz);
+    Matrix<Uint8> part_b(ksz, ksz);
+
+    constexpr int szg = 256;
+    array<int, szg> hist_r{ 0 };
+    array<int, szg> hist_g{ 0 };
+    array<int, szg> hist_b{ 0 };
+
+    for (int i = begin_x; i < end_x; ++i)
+    {
+        for (int j = begin_y; j < end_y; ++j)
+        {
+            fillTmpMatrix(part_r, part_g, part_b, tile, ksz, i, j);
+
+            bool is_new_line = (j == 0);
+
+            QRgb tmp = qRgb(find_median(part_r, hist_r, is_new_line),
+                            find_median(part_g, hist_g, is_new_line),
+                            find_median(part_b, hist_b, is_new_line)
+                            );
+
+            dst.at(i, j) = tmp;
+        }
+    }
+}
+
+// Медиана за O(1) на пиксель (Perreault, Hébert). Для каждого столбца хранится гистограмма
+// ksz строк вокруг текущей, она скользит вниз по строкам; гистограмма окна скользит вдоль строки.
+// Грубые 16-бинные гистограммы окна обновляются на каждом пикселе, точные - лениво и только
+// для того сегмента из 16 бинов, в котором лежит медиана.
+constexpr int MedianCTMinKsz = 7;
+
+struct MedianChannel
+{
+    vector<uint16_t> col_coarse;    // [width][16]
+    vector<uint16_t> col_fine;      // [width][256]
+    array<uint16_t, 16> coarse;
+    array<uint16_t, 256> fine;
+    array<int, 16> luc;             // столбец, до которого (не включая) обновлён сегмент fine
+
+    explicit MedianChannel(const int width) : col_coarse(16 * width), col_fine(256 * width) {}
+
+    void update_col(const int x, const Uint8 v, const uint16_t delta) noexcept
+    {
+        col_coarse[16 * x + (v >> 4)] += delta;
+        col_fine[256 * x + v] += delta;
+    }
+
+    // столбцы - с полями: столбец x изображения хранится под индексом x + r
+    void start_row(const int r) noexcept
+    {
+        coarse.fill(0);
+
+        for (int x = -r; x <= r; ++x)
+        {
+            const uint16_t* col = &col_coarse[16 * (x + r)];
+
+            for (int k = 0; k < 16; ++k)
+                coarse[k] += col[k];
+        }
+
+        luc.fill(numeric_limits<int>::min() / 2);
+    }
+
+    void slide(const int i, const int r) noexcept
+    {
+        const uint16_t* in = &col_coarse[16 * (i + r + r)];
+        const uint16_t* out = &col_coarse[16 * (i - 1)];
+
+        for (int k = 0; k < 16; ++k)
+            coarse[k] += in[k] - out[k];
+    }
+
+    Uint8 median(const int i, const int ksz, const int half) noexcept
+    {
+        const int r = ksz / 2;
+
+        int count = 0;
+        int b = 0;
+        for (; b < 15; ++b)
         {
-            int posPixX = i - ksz_2 + x;
-            int posPixY = j - ksz_2 + y;
+            if (count + coarse[b] > half)
+                break;
+
+            count += coarse[b];
+        }
+
+        uint16_t* seg = &fine[16 * b];
+        const int right = i + r;
+
+        if (right - luc[b] + 1 > ksz)
+        {
+            fill(seg, seg + 16, 0);
+
+            for (int x = i - r; x <= right; ++x)
+            {
+                const uint16_t* col = &col_fine[256 * (x + r) + 16 * b];
+
+                for (int k = 0; k < 16; ++k)
+                    seg[k] += col[k];
+            }
+        }
+        else {
+            for (int x = luc[b]; x <= right; ++x)
+            {
+                const uint16_t* in = &col_fine[256 * (x + r) + 16 * b];
+                const uint16_t* out = &col_fine[256 * (x - ksz + r) + 16 * b];
+
+                for (int k = 0; k < 16; ++k)
+                    seg[k] += in[k] - out[k];
+            }
+        }
+
+        luc[b] = right + 1;
+
+        int k = 0;
+        for (; k < 15; ++k)
+        {
+            count += seg[k];
+            if (count > half)
+                break;
+        }
+
+        return static_cast<Uint8>(16 * b + k);
+    }
+};
+
+void MedianFilterCTLoop(const ConstImageView& src, const ImageView& dst, const int ksz, const Border& border,
+                        const int begin_y, const int end_y)
+{
+    const int width = src.width();
+    const int r = ksz / 2;
+    const int half = ksz * ksz / 2;
+    const int padded = width + 2 * r;
+
+    PaddedTile tile;
+    tile.fill(src, 0, width, begin_y, end_y, r, r, border);
+
+    vector<MedianChannel> ch(3, MedianChannel(padded));
 
-            b_ctrl(posPixX, width);
-            b_ctrl(posPixY, height);
+    auto add_row = [&](const int y, const uint16_t delta){
+        const QRgb* line = tile.line(y) - r;
 
-            QRgb tmpc = img->pixel(posPixX, posPixY);
+        for (int x = 0; x < padded; ++x)
+        {
+            const QRgb c = line[x];
 
-            red[x][y] = qRed(tmpc);
-            green[x][y] = qGreen(tmpc);
-            blue[x][y] = qBlue(tmpc);
+            ch[0].update_col(x, qRed(c), delta);
+            ch[1].update_col(x, qGreen(c), delta);
+            ch[2].update_col(x, qBlue(c), delta);
         }
-    }
-}
-
+    };
 
-ImageProc::ImageProc(QObject *parent):QObject(parent) {}
+    for (int y = begin_y - r; y <= begin_y + r; ++y)
+        add_row(y, 1);
 
-void ImageProc::rotate_left(QImage *img)
-{
-    if(img->isNull())
-        return;
+    for (int j = begin_y; j < end_y; ++j)
+    {
+        if (j != begin_y)
+        {
+            add_row(j + r, 1);
+            add_row(j - r - 1, static_cast<uint16_t>(-1));
+        }
 
-    int width =  img->width();
-    int height = img->height();
+        for (auto& c : ch)
+            c.start_row(r);
 
-    QImage new_img(height, width, QImage::Format_RGB32);
+        QRgb* out = dst.line(j);
 
-    for (int i = 0; i < width; i++) {
-        for (int j = 0; j < height; j++) {
-            new_img.setPixel(j, width - 1 - i, img->pixel(i, j));
+        for (int i = 0; i < width; ++i)
+        {
+            if (i != 0)
+            {
+                for (auto& c : ch)
+                    c.slide(i, r);
+            }
+
+            out[i] = qRgb(ch[0].median(i, ksz, half),
+                          ch[1].median(i, ksz, half),
+                          ch[2].median(i, ksz, half));
         }
     }
-
-    *img = move(new_img);
 }
 
-void ImageProc::rotate_right(QImage *img)
+// то же по одной плоскости
+void MedianPlaneCTLoop(const ConstPlaneView& src, const PlaneView& dst, const int ksz, const BorderMode mode,
+                       const uchar edge, const int begin_y, const int end_y)
 {
-    if(img->isNull())
-        return;
+    const int width = src.width();
+    const int r = ksz / 2;
+    const int half = ksz * ksz / 2;
+    const int padded = width + 2 * r;
 
-    int width = img->width();
-    int height = img->height();
+    PlaneTile tile;
+    tile.fill(src, 0, width, begin_y, end_y, r, r, mode, edge);
 
-    QImage new_img(height, width, QImage::Format_RGB32);
+    MedianChannel ch(padded);
 
-    for (int i = 0; i < width; i++) {
-        for (int j = 0; j < height; j++) {
-            new_img.setPixel(height - 1 - j, i, img->pixel(i, j));
-        }
-    }
+    auto add_row = [&](const int y, const uint16_t delta){
+        const uchar* line = tile.line(y) - r;
 
-    *img = move(new_img);
-}
+        for (int x = 0; x < padded; ++x)
+            ch.update_col(x, line[x], delta);
+    };
 
-void ImageProc::LinearCorr(QImage* img)
-{
-    if(img->isNull())
-        return;
+    for (int y = begin_y - r; y <= begin_y + r; ++y)
+        add_row(y, 1);
 
-    auto Cfirst = ConstMyColorIterator::CBegin(*img);
-    auto Clast = ConstMyColorIterator::CEnd(*img);
+    for (int j = begin_y; j < end_y; ++j)
+    {
+        if (j != begin_y)
+        {
+            add_row(j + r, 1);
+            add_row(j - r - 1, static_cast<uint16_t>(-1));
+        }
 
-    auto mmc = MinMaxColor(Cfirst, Clast);
+        ch.start_row(r);
 
-    const double divR = get<0>(mmc).second - get<0>(mmc).first;
-    const double divG = get<1>(mmc).second - get<1>(mmc).first;
-    const double divB = get<2>(mmc).second - get<2>(mmc).first;
+        uchar* out = dst.line(j);
 
-    auto corr = [](const uchar curr, const uchar min, const double div){
-        return (curr - min) * 255.0 / div;
-    };
+        for (int i = 0; i < width; ++i)
+        {
+            if (i != 0)
+                ch.slide(i, r);
 
-    auto first = MyColorIterator::Begin(*img);
-    auto last = MyColorIterator::End(*img);
+            out[i] = ch.median(i, ksz, half);
+        }
+    }
+}
 
-    ForEachPixel(first, last, [&corr, &mmc, &divR, &divG, &divB](QRgb& pixel){
-        return qRgb(corr(qRed(pixel), get<0>(mmc).first, divR),
-                    corr(qGreen(pixel), get<1>(mmc).first, divG),
-                    corr(qBlue(pixel), get<2>(mmc).first, divB));
-    });
+inline uchar med3(const uchar a, const uchar b, const uchar c) noexcept
+{
+    return max(min(a, b), min(max(a, b), c));
 }
 
-void ImageProc::GrayWorld(QImage* img)
+// Медиана 3x3 по плоскости: каждый столбец окна сортируется (lo <= mid <= hi), медиана девяти -
+// med3(max трёх lo, med3 трёх mid, min трёх hi). Только min/max над подряд идущими байтами,
+// поэтому циклы векторизуются; отсортированный столбец используется тремя соседними окнами.
+void Median3PlaneLoop(const ConstPlaneView& src, const PlaneView& dst, const BorderMode mode, const uchar edge,
+                      const int begin_y, const int end_y)
 {
-    if(img->isNull())
-        return;
+    const int width = src.width();
+    const int padded = width + 2;
 
-    auto Cfirst = ConstMyColorIterator::CBegin(*img);
-    auto Clast = ConstMyColorIterator::CEnd(*img);
+    PlaneTile tile;
+    tile.fill(src, 0, width, begin_y, end_y, 1, 1, mode, edge);
 
-    auto summ = ColorSum(Cfirst, Clast);
+    vector<uchar> lo(padded);
+    vector<uchar> mid(padded);
+    vector<uchar> hi(padded);
 
-    const double countPixels = static_cast<double>(img->width() * img->height());
+    for (int j = begin_y; j < end_y; ++j)
+    {
+        const uchar* a = tile.line(j - 1) - 1;
+        const uchar* b = tile.line(j) - 1;
+        const uchar* c = tile.line(j + 1) - 1;
 
-    double avgR = get<0>(summ) / countPixels;
-    double avgG = get<1>(summ) / countPixels;
-    double avgB = get<2>(summ) / countPixels;
+        for (int x = 0; x < padded; ++x)
+        {
+            const uchar l = min(a[x], b[x]);
+            const uchar h = max(a[x], b[x]);
 
-    double avgAll = (avgR + avgG + avgB) / 3.0;
+            lo[x] = min(l, c[x]);
+            hi[x] = max(h, c[x]);
+            mid[x] = max(l, min(h, c[x]));
+        }
 
-    avgR = avgAll / avgR;
-    avgG = avgAll / avgG;
-    avgB = avgAll / avgB;
+        uchar* out = dst.line(j);
 
-    auto first = MyColorIterator::Begin(*img);
-    auto last = MyColorIterator::End(*img);
+        for (int i = 0; i < width; ++i)
+        {
+            const uchar l = max(max(lo[i], lo[i + 1]), lo[i + 2]);
+            const uchar m = med3(mid[i], mid[i + 1], mid[i + 2]);
+            const uchar h = min(min(hi[i], hi[i + 1]), hi[i + 2]);
 
-    ForEachPixel(first, last, [&avgR, &avgG, &avgB](QRgb& pixel){
-        return qRgb(ovfctrl(qRed(pixel) * avgR),
-                    ovfctrl(qGreen(pixel) * avgG),
-                    ovfctrl(qBlue(pixel) * avgB));
-    });
+            out[i] = med3(l, m, h);
+        }
+    }
 }
 
-void ImageProc::GammaFunc(QImage* img, double c, double d)
+void ImageProc::MedianFilter(QImage* img, const int ksz)
 {
     if(img->isNull())
         return;
 
-    auto first = MyColorIterator::Begin(*img);
-    auto last = MyColorIterator::End(*img);
+    int width = img->width();
+    int height = img->height();
 
-    ForEachPixel(first, last, [&c, &d](QRgb& pixel){
-        return qRgb(ovfctrl(round(c * pow(qRed(pixel), d))),
-                    ovfctrl(round(c * pow(qGreen(pixel), d))),
-                    ovfctrl(round(c * pow(qBlue(pixel), d)))
-                    );
-    });
-}
+    if (ksz % 2 == 0 || ksz < 3 || ksz > width || ksz > height)
+        return;
 
-template<const Index ksz>
-void GaussBlurLoop(QImage* img, SMatrix<double, ksz, ksz>& kernel, const double div,
-                   const int begin_x, const int begin_y, const int end_x, const int end_y)
-{
-    Matrix<Uint8> part_r(ksz, ksz);
-    Matrix<Uint8> part_g(ksz, ksz);
-    Matrix<Uint8> part_b(ksz, ksz);
+    const ConstImageView src = ViewOf(*img);
+    const ImageView dst = MutableViewOf(Target(img));
 
-    for(int i = begin_x; i < end_x; ++i)
+    if (ksz >= MedianCTMinKsz)
     {
-        for(int j = begin_y; j < end_y; ++j)
-        {
-            fillTmpMatrix(part_r, part_g, part_b, img, ksz, i, j);
+        // каждая полоса заново набирает гистограммы столбцов по ksz строкам, поэтому полосы не короче 4 * ksz
+        ParallelFor(running, 0, height, BandRows(width, 4 * ksz), [&](int begin_y, int end_y){
+            MedianFilterCTLoop(src, dst, ksz, border, begin_y, end_y);
+        });
 
-            int r = inner_product(part_r.cbegin(), part_r.cend(), kernel.cbegin(), 0.0) / div;
-            int g = inner_product(part_g.cbegin(), part_g.cend(), kernel.cbegin(), 0.0) / div;
-            int b = inner_product(part_b.cbegin(), part_b.cend(), kernel.cbegin(), 0.0) / div;
-
-            img->setPixel(i, j, qRgb(r, g, b));
-        }
+        Commit(img);
+        return;
     }
+
+    // здесь окно идёт вниз по столбцу, поэтому куски - полосы столбцов на всю высоту
+    ParallelFor(running, 0, width, 16, [&](int begin_x, int end_x){
+        MedianFilterLoop(src, dst, ksz, border, begin_x, 0, end_x, height);
+    });
+
+    Commit(img);
 }
 
-void ImageProc::GaussBlur(QImage* img)
+void ImageProc::MedianFilter(PlanarImage* img, const int ksz)
 {
     if(img->isNull())
         return;
 
     const int width = img->width();
     const int height = img->height();
-    constexpr int ksz = 5;
-
-    SMatrix<double, ksz, ksz> kernel = {
-        0.000789, 0.006581, 0.013347, 0.006581, 0.000789,
-        0.006581, 0.054901, 0.111345, 0.054901, 0.006581,
-        0.013347, 0.111345, 0.225821, 0.111345, 0.013347,
-        0.006581, 0.054901, 0.111345, 0.054901, 0.006581,
-        0.000789, 0.006581, 0.013347, 0.006581, 0.000789
-    };
-
-    double div = std::accumulate(kernel.cbegin(), kernel.cend(), 0.0);
 
-//    Matrix<Uint8> part_r(ksz, ksz);
-//    Matrix<Uint8> part_g(ksz, ksz);
-//    Matrix<Uint8> part_b(ksz, ksz);
-
-//    for (int i = 0; i < width; i++)
-//    {
-//        for (int j = 0; j < height; j++)
-//        {
-//            fillTmpMatrix(part_r, part_g, part_b, img, ksz, i, j);
+    if (ksz % 2 == 0 || ksz < 3 || ksz > width || ksz > height)
+        return;
 
-//            int r = inner_product(part_r.cbegin(), part_r.cend(), kernel.cbegin(), 0.0) / div;
-//            int g = inner_product(part_g.cbegin(), part_g.cend(), kernel.cbegin(), 0.0) / div;
-//            int b = inner_product(part_b.cbegin(), part_b.cend(), kernel.cbegin(), 0.0) / div;
+    PlanarImage& out = Target(*img);
 
-//            img->setPixel(i, j, qRgb(r, g, b));
-//        }
-//    }
+    // гистограммы CT-медианы набираются заново в каждой полосе, поэтому полосы не короче 4 * ksz
+    const int band = ksz == 3 ? PlaneBandRows(width) : PlaneBandRows(width, 4 * ksz);
 
-    auto f1 = std::async(std::launch::async, GaussBlurLoop<ksz>, img, std::ref(kernel), div, 0, 0, width, height / 3);
-    auto f2 = std::async(std::launch::async, GaussBlurLoop<ksz>, img, std::ref(kernel), div, 0, height / 3, width, (height / 3) * 2);
-    auto f3 = std::async(std::launch::async, GaussBlurLoop<ksz>, img, std::ref(kernel), div, 0, (height / 3) * 2, width, height);
+    for (int c = 0; c < PlanarImage::Planes; ++c)
+    {
+        const ConstPlaneView src = img->plane(c);
+        const PlaneView dst = out.plane(c);
+        const uchar edge = PlanarImage::channel(border.constant, c);
+
+        ParallelFor(running, 0, height, band, [&](int begin_y, int end_y){
+            if (ksz == 3)
+                Median3PlaneLoop(src, dst, border.mode, edge, begin_y, end_y);
+            else
+                MedianPlaneCTLoop(src, dst, ksz, border.mode, edge, begin_y, end_y);
+        });
+    }
 
-    f1.wait();
-    f2.wait();
-    f3.wait();
+    Commit(img);
 }
 
-void MedianFilterLoop(QImage* img, QImage& new_img, const int ksz, const int begin_x, const int begin_y, const int end_x, const int end_y)
+void ImageProc::BoxFilter(QImage* img, const int kw, const int kh)
 {
-    Matrix<Uint8> part_r(ksz, ksz);
-    Matrix<Uint8> part_g(ksz, ksz);
-    Matrix<Uint8> part_b(ksz, ksz);
+    if(img->isNull())
+        return;
 
-    constexpr int szg = 256;
-    array<int, szg> hist_r{ 0 };
-    array<int, szg> hist_g{ 0 };
-    array<int, szg> hist_b{ 0 };
+    const int width = img->width();
+    const int height = img->height();
 
-    for (int i = begin_x; i < end_x; ++i)
-    {
-        for (int j = begin_y; j < end_y; ++j)
-        {
-            fillTmpMatrix(part_r, part_g, part_b, img, ksz, i, j);
+    if (kw % 2 == 0 || kh % 2 == 0 || kw < 1 || kh < 1 || kw > width || kh > height)
+        return;
 
-            bool is_new_line = (j == 0);
+    const ConstImageView src = ViewOf(*img);
+    const ImageView dst = MutableViewOf(Target(img));
 
-            QRgb tmp = qRgb(find_median(part_r, hist_r, is_new_line),
-                            find_median(part_g, hist_g, is_new_line),
-                            find_median(part_b, hist_b, is_new_line)
-                            );
+    // таблица сумм полосы захватывает kh - 1 лишних строк: полосы не короче kh, чтобы они
+    // не стоили больше самих строк, но и не длиннее - таблица полосы 12 байт на пиксель
+    ParallelFor(running, 0, height, BandRows(width, kh), [&](int begin_y, int end_y){
+        BoxFilterLoop(src, dst, kw, kh, border, begin_y, end_y);
+    });
 
-            new_img.setPixel(i, j, tmp);
-        }
-    }
+    Commit(img);
 }
 
-void ImageProc::MedianFilter(QImage* img, const int ksz)
+void ImageProc::CustomFilter(QImage *img, vector<double>* kernel)
 {
     if(img->isNull())
         return;
 
     int width = img->width();
     int height = img->height();
+    const int ksz = static_cast<int>(sqrt(kernel->size()));
 
     if (ksz % 2 == 0 || ksz < 3 || ksz > width || ksz > height)
         return;
 
-    QImage new_img(width, height, QImage::Format_RGB32);
+    // равные веса - среднее по окну: четыре обращения к таблице сумм на пиксель при любом ksz
+    if (IsUniformKernel(*kernel))
+    {
+        BoxFilter(img, ksz, ksz);
+        return;
+    }
 
-    auto f1 = std::async(std::launch::async, MedianFilterLoop, img, std::ref(new_img),
-                         ksz, 0, 0, width / 3, height);
+    double div = accumulate(kernel->cbegin(), kernel->cend(), 0.0);
 
-    auto f2 = std::async(std::launch::async, MedianFilterLoop, img, std::ref(new_img),
-                         ksz, width / 3, 0, (width / 3) * 2, height);
+    if (div == 0.0)
+        div = 1.0;
 
-    auto f3 = std::async(std::launch::async, MedianFilterLoop, img, std::ref(new_img),
-                         ksz, (width / 3) * 2, 0, width, height);
+    // Если веса удаётся квантовать, свёртка идёт в целых числах (результат не больше чем на 1
+    // выше, чем в double, см. convolve.h): с SIMD - 16-битные веса, без него - развёрнутые
+    // ядра 3..9 с 32-битными весами. Остальное - в double.
+    enum class Path { Double, Fixed, Fixed16, Taps, Separable, Fft };
 
-    f1.wait();
-    f2.wait();
-    f3.wait();
+    FixedKernel fixed;
+    Path path = Path::Double;
 
-//    Matrix<Uint8> part_r(ksz, ksz);
-//    Matrix<Uint8> part_g(ksz, ksz);
-//    Matrix<Uint8> part_b(ksz, ksz);
+    if (ActiveSimdLevel() != SimdLevel::Scalar && QuantizeKernel16(*kernel, div, &fixed))
+        path = Path::Fixed16;
+    else if (HasFixedKernel(ksz) && QuantizeKernel(*kernel, div, &fixed))
+        path = Path::Fixed;
 
-//    const int szg = 256;
-//    array<int, szg> hist_r{ 0 };
-//    array<int, szg> hist_g{ 0 };
-//    array<int, szg> hist_b{ 0 };
+    // Ядра с нулями и симметричными парами дешевле считать списком слагаемых, большие - блоками
+    // через БПФ, ядра малого ранга - сепарабельными проходами; из путей выбирается самый
+    // дешёвый по оценке времени на пиксель.
+    double cost = (path == Path::Fixed16 ? Fixed16Cost : DenseCost) * static_cast<double>(ksz) * ksz;
 
-//    for (int i = 0; i < width; i++)
-//    {
-//        for (int j = 0; j < height; j++)
-//        {
-//            fillTmpMatrix(part_r, part_g, part_b, img, ksz, i, j);
+    // список - те же целые суммы, что у Fixed и Fixed16; без них - 32-битные веса любого ksz
+    TapKernel taps;
 
-//            bool is_new_line = (j == 0);
+    if (path != Path::Double || QuantizeKernel(*kernel, div, &fixed))
+    {
+        taps = CompileTaps(fixed);
 
-//            QRgb tmp = qRgb(find_median(part_r, hist_r, is_new_line),
-//                            find_median(part_g, hist_g, is_new_line),
-//                            find_median(part_b, hist_b, is_new_line)
-//                            );
+        if (TapsCost(taps) < cost)
+        {
+            cost = TapsCost(taps);
+            path = Path::Taps;
+        }
+    }
 
-//            new_img.setPixel(i, j, tmp);
-//        }
-//    }
+    const int fft_n = FftBlockSize(ksz, width, height);
 
-    *img = move(new_img);
-}
+    if (fft_n > 0 && FftCost(fft_n, ksz, width, height) < cost && FftAccurate(*kernel, div))
+    {
+        cost = FftCost(fft_n, ksz, width, height);
+        path = Path::Fft;
+    }
 
-void CustomFilterLoop(QImage* img, QImage& new_img, vector<double>* kernel, const int ksz, const double div,
-                      const int begin_x, const int begin_y, const int end_x, const int end_y)
-{
-    Matrix<Uint8> part_r(ksz, ksz);
-    Matrix<Uint8> part_g(ksz, ksz);
-    Matrix<Uint8> part_b(ksz, ksz);
+    // отброшенный остаток ядра меняет частное меньше чем на 0.1 * SeparableBias
+    vector<SeparableTerm> terms;
+    const int max_rank = SeparableMaxRank(ksz, cost);
+
+    if (max_rank > 0 && DecomposeKernel(*kernel, ksz, max_rank, 0.1 * SeparableBias * fabs(div) / 255, &terms))
+        path = Path::Separable;
 
-    for (int i = begin_x; i < end_x; i++)
+    unique_ptr<Fft2D> fft;
+    vector<complex<double>> spectrum;
+
+    if (path == Path::Fft)
     {
-        for (int j = begin_y; j < end_y; j++)
-        {
-            fillTmpMatrix(part_r, part_g, part_b, img, ksz, i, j);
+        fft.reset(new Fft2D(fft_n));
+        spectrum = KernelSpectrum(*kernel, ksz, div, *fft);
+    }
+
+    const ConstImageView src = ViewOf(*img);
+    const ImageView dst = MutableViewOf(Target(img));
 
-            int r = inner_product(part_r.cbegin(), part_r.cend(), kernel->cbegin(), 0.0) / div;
-            int g = inner_product(part_g.cbegin(), part_g.cend(), kernel->cbegin(), 0.0) / div;
-            int b = inner_product(part_b.cbegin(), part_b.cend(), kernel->cbegin(), 0.0) / div;
+    // сепарабельным проходам полоса нужна не короче окна: строки полей считаются заново в каждой;
+    // БПФ - по ряду блоков на полосу
+    int band = BandRows(width);
 
-            QRgb tmpc = qRgb(ovfctrl(r), ovfctrl(g), ovfctrl(b));
+    if (path == Path::Separable)
+        band = BandRows(width, 4 * ksz);
+    else if (path == Path::Fft)
+        band = fft_n - ksz + 1;
 
-            new_img.setPixel(i, j, tmpc);
+    ParallelFor(running, 0, height, band, [&](int begin_y, int end_y){
+        switch (path)
+        {
+        case Path::Taps:
+            ConvolveTaps(src, dst, taps, border, begin_y, end_y);
+            break;
+        case Path::Fft:
+            ConvolveFft(src, dst, *fft, spectrum, ksz, border, begin_y, end_y);
+            break;
+        case Path::Separable:
+            ConvolveSeparableLoop(src, dst, terms, ksz, div, border, begin_y, end_y);
+            break;
+        case Path::Fixed16:
+            ConvolveFixed16(src, dst, fixed, border, begin_y, end_y);
+            break;
+        case Path::Fixed:
+            ConvolveFixed(src, dst, fixed, border, begin_y, end_y);
+            break;
+        default:
+            ConvolveLoop(src, dst, kernel, ksz, div, border, begin_y, end_y);
         }
-    }
+    });
+
+    Commit(img);
 }
 
-void ImageProc::CustomFilter(QImage *img, vector<double>* kernel)
+// Минимум/максимум в скользящем окне длины k (van Herk, Gil-Werman), ~3 сравнения на элемент.
+// in - (n + k - 1) * lanes байт, уже дополненных по краям, out - n * lanes байт.
+// Элементы одной позиции идут подряд (lanes штук) и обрабатываются независимо.
+template<typename Op>
+void RunningExtremum(const Uint8* in, Uint8* out, Uint8* g, Uint8* h,
+                     const int n, const int k, const int lanes, Op op)
 {
-    if(img->isNull())
-        return;
+    const int len = n + k - 1;
 
-    int width = img->width();
-    int height = img->height();
-    const int ksz = static_cast<int>(sqrt(kernel->size()));
+    // g - накопление от начала блока длины k, h - от конца блока
+    for (int x = 0; x < len; ++x)
+    {
+        const Uint8* src = in + x * lanes;
+        Uint8* dg = g + x * lanes;
+
+        if (x % k == 0)
+            copy(src, src + lanes, dg);
+        else
+            for (int l = 0; l < lanes; ++l)
+                dg[l] = op(dg[l - lanes], src[l]);
+    }
 
-    if (ksz % 2 == 0 || ksz < 3 || ksz > width || ksz > height)
-        return;
+    for (int x = len - 1; x >= 0; --x)
+    {
+        const Uint8* src = in + x * lanes;
+        Uint8* dh = h + x * lanes;
+
+        if (x % k == k - 1 || x == len - 1)
+            copy(src, src + lanes, dh);
+        else
+            for (int l = 0; l < lanes; ++l)
+                dh[l] = op(dh[l + lanes], src[l]);
+    }
+
+    for (int x = 0; x < n; ++x)
+    {
+        const Uint8* hx = h + x * lanes;
+        const Uint8* gx = g + (x + k - 1) * lanes;
+        Uint8* o = out + x * lanes;
 
-    const double div = accumulate(kernel->cbegin(), kernel->cend(), 0.0);
+        for (int l = 0; l < lanes; ++l)
+            o[l] = op(hx[l], gx[l]);
+    }
+}
 
-    QImage new_img(width, height, QImage::Format_RGB32);
+// горизонтальный проход по строкам [begin_y, end_y): окно kw пикселей, все 4 байта пикселя - дорожки
+template<typename Op>
+void MorphologyRows(const ConstImageView& src, uchar* tmp, const int kw, const Border& border,
+                    const int begin_y, const int end_y, Op op)
+{
+    const int width = src.width();
+    const int r = kw / 2;
+    const int len = width + kw - 1;
 
-    auto f1 = std::async(std::launch::async, CustomFilterLoop, img, std::ref(new_img), kernel, ksz, div, 0, 0, width / 3, height);
-    auto f2 = std::async(std::launch::async, CustomFilterLoop, img, std::ref(new_img), kernel, ksz, div, width / 3, 0, (width / 3) * 2, height);
-    auto f3 = std::async(std::launch::async, CustomFilterLoop, img, std::ref(new_img), kernel, ksz, div, (width / 3) * 2, 0, width, height);
+    PaddedTile tile;
+    tile.fill(src, 0, width, begin_y, end_y, r, 0, border);
 
-    f1.wait();
-    f2.wait();
-    f3.wait();
+    vector<Uint8> g(4 * len);
+    vector<Uint8> h(4 * len);
 
-//    Matrix<Uint8> part_r(ksz, ksz);
-//    Matrix<Uint8> part_g(ksz, ksz);
-//    Matrix<Uint8> part_b(ksz, ksz);
+    for (int j = begin_y; j < end_y; ++j)
+    {
+        const Uint8* pad = reinterpret_cast<const Uint8*>(tile.line(j) - r);
 
-//    for (int i = 0; i < width; i++)
-//    {
-//        for (int j = 0; j < height; j++)
-//        {
-//            fillTmpMatrix(part_r, part_g, part_b, img, ksz, i, j);
+        RunningExtremum(pad, tmp + 4 * static_cast<size_t>(j) * width, g.data(), h.data(),
+                        width, kw, 4, op);
+    }
+}
 
-//            int r = inner_product(part_r.cbegin(), part_r.cend(), kernel->cbegin(), 0.0) / div;
-//            int g = inner_product(part_g.cbegin(), part_g.cend(), kernel->cbegin(), 0.0) / div;
-//            int b = inner_product(part_b.cbegin(), part_b.cend(), kernel->cbegin(), 0.0) / div;
+// то же по одной плоскости: байт на пиксель, дорожка одна
+template<typename Op>
+void MorphologyPlaneRows(const ConstPlaneView& src, uchar* tmp, const int kw, const BorderMode mode, const uchar edge,
+                         const int begin_y, const int end_y, Op op)
+{
+    const int width = src.width();
+    const int r = kw / 2;
+    const int len = width + kw - 1;
 
-//            QRgb tmpc = qRgb(ovfctrl(r), ovfctrl(g), ovfctrl(b));
+    PlaneTile tile;
+    tile.fill(src, 0, width, begin_y, end_y, r, 0, mode, edge);
 
-//            new_img.setPixel(i, j, tmpc);
-//        }
-//    }
+    vector<Uint8> g(len);
+    vector<Uint8> h(len);
 
-    *img = move(new_img);
+    for (int j = begin_y; j < end_y; ++j)
+        RunningExtremum(tile.line(j) - r, tmp + static_cast<size_t>(j) * width, g.data(), h.data(), width, kw, 1, op);
 }
 
-void ErosionLoop(QImage* img, QImage& new_img, const int ksz,
-                 const int begin_x, const int begin_y, const int end_x, const int end_y)
+// Вертикальный проход по полосам из MorphologyStrip байт в [begin_x, end_x): окно kh строк.
+// Байты строки обрабатываются независимо, поэтому dst - окно в байтах: 4 байта на пиксель
+// упакованного изображения или байт на пиксель плоскости. tmp - те же строки подряд,
+// edge - MorphologyStrip байт строки за краем для Constant.
+constexpr int MorphologyStrip = 64;
+
+template<typename Op>
+void MorphologyCols(const uchar* tmp, const PlaneView& dst, const BorderMode mode, const Uint8* edge,
+                    const int kh, const int begin_x, const int end_x, Op op)
 {
-    Matrix<Uint8> part_r(ksz, ksz);
-    Matrix<Uint8> part_g(ksz, ksz);
-    Matrix<Uint8> part_b(ksz, ksz);
+    constexpr int strip = MorphologyStrip;
 
-    constexpr int szg = 256;
-    array<int, szg> hist_r{ 0 };
-    array<int, szg> hist_g{ 0 };
-    array<int, szg> hist_b{ 0 };
+    const int width = dst.width();
+    const int height = dst.height();
+    const int r = kh / 2;
+    const int len = height + kh - 1;
 
-    for (int i = begin_x; i < end_x; ++i)
+    vector<Uint8> buf(strip * len);
+    vector<Uint8> g(strip * len);
+    vector<Uint8> h(strip * len);
+    vector<Uint8> out(strip * height);
+
+    for (int x0 = begin_x; x0 < end_x; x0 += strip)
     {
-        for (int j = begin_y; j < end_y; ++j)
-        {
-            fillTmpMatrix(part_r, part_g, part_b, img, ksz, i, j);
+        const int lanes = min(strip, end_x - x0);
 
-            bool is_new_s = (j == 0);
+        for (int y = -r; y < height + r; ++y)
+        {
+            const int pos = BorderIndex(y, height, mode);
+            const uchar* src = pos < 0 ? edge : tmp + static_cast<size_t>(pos) * width + x0;
+            copy(src, src + lanes, buf.data() + (y + r) * lanes);
+        }
 
+        RunningExtremum(buf.data(), out.data(), g.data(), h.data(), height, kh, lanes, op);
 
-            new_img.setPixel(i, j, qRgb(
-                             find_min(part_r, hist_r, is_new_s),
-                             find_min(part_g, hist_g, is_new_s),
-                             find_min(part_b, hist_b, is_new_s)
-                             ));
+        for (int y = 0; y < height; ++y)
+        {
+            const Uint8* src = out.data() + y * lanes;
+            copy(src, src + lanes, dst.line(y) + x0);
         }
     }
 }
 
-void ImageProc::Erosion(QImage *img, int ksz)
+template<typename Op>
+void MorphologyFilter(OpProgress* job, const ConstImageView& src, uchar* tmp, const ImageView& dst,
+                      const int kw, const int kh, const Border& border, Op op)
 {
-    if(img->isNull())
-        return;
-
-    int width = img->width();
-    int height = img->height();
-
-    if (ksz % 2 == 0 || ksz < 3 || ksz > width || ksz > height)
-        return;
+    const int width = src.width();
+    const int height = src.height();
 
-    QImage new_img(width, height, QImage::Format_RGB32);
-
-//    Matrix<Uint8> part_r(ksz, ksz);
-//    Matrix<Uint8> part_g(ksz, ksz);
-//    Matrix<Uint8> part_b(ksz, ksz);
-
-//    const int szg = 256;
-//    array<int, szg> hist_r{ 0 };
-//    array<int, szg> hist_g{ 0 };
-//    array<int, szg> hist_b{ 0 };
+    ParallelFor(job, 0, height, BandRows(width), [&](int begin_y, int end_y){
+        MorphologyRows<Op>(src, tmp, kw, border, begin_y, end_y, op);
+    });
 
-//    for (int i = 0; i < width; i++)
-//    {
-//        for (int j = 0; j < height; j++)
-//        {
-//            fillTmpMatrix(part_r, part_g, part_b, img, ksz, i, j);
+    const PlaneView bytes(dst.bits(), 4 * width, height, dst.stride(), QImage::Format_Grayscale8);
+    const vector<QRgb> edge(MorphologyStrip / 4, border.constant);
 
-//            bool is_new_s = (j == 0);
+    // По 4 полосы MorphologyCols на кусок, чтобы буферы выделялись реже. Альфа проходит через
+    // min/max вместе с каналами, поэтому затем, пока полоса в кэше, она снова 255 - как у остальных
+    // фильтров (и у плоскостей PlanarImage)
+    ParallelFor(job, 0, bytes.width(), 4 * MorphologyStrip, [&](int begin_x, int end_x){
+        MorphologyCols<Op>(tmp, bytes, border.mode, reinterpret_cast<const Uint8*>(edge.data()), kh, begin_x, end_x, op);
 
+        for (int y = 0; y < height; ++y)
+        {
+            QRgb* line = dst.line(y);
 
-//            new_img.setPixel(i, j, qRgb(
-//                             find_min(part_r, hist_r, is_new_s),
-//                             find_min(part_g, hist_g, is_new_s),
-//                             find_min(part_b, hist_b, is_new_s)
-//                             ));
-//        }
-//    }
+            for (int i = begin_x / 4; i < end_x / 4; ++i)
+                line[i] |= 0xff000000u;
+        }
+    });
+}
 
-    auto f1 = std::async(std::launch::async, ErosionLoop, img, std::ref(new_img), ksz, 0, 0, width / 3, height);
-    auto f2 = std::async(std::launch::async, ErosionLoop, img, std::ref(new_img), ksz, width / 3, 0, (width / 3) * 2, height);
-    auto f3 = std::async(std::launch::async, ErosionLoop, img, std::ref(new_img), ksz, (width / 3) * 2, 0, width, height);
+template<typename Op>
+void MorphologyPlane(OpProgress* job, const ConstPlaneView& src, uchar* tmp, const PlaneView& dst,
+                     const int kw, const int kh, const BorderMode mode, const uchar edge, Op op)
+{
+    ParallelFor(job, 0, src.height(), PlaneBandRows(src.width()), [&](int begin_y, int end_y){
+        MorphologyPlaneRows<Op>(src, tmp, kw, mode, edge, begin_y, end_y, op);
+    });
 
-    f1.wait();
-    f2.wait();
-    f3.wait();
+    const vector<Uint8> edge_row(MorphologyStrip, edge);
 
-    *img = move(new_img);
+    ParallelFor(job, 0, dst.width(), 4 * MorphologyStrip, [&](int begin_x, int end_x){
+        MorphologyCols<Op>(tmp, dst, mode, edge_row.data(), kh, begin_x, end_x, op);
+    });
 }
 
-void IncreaseLoop(QImage* img, QImage& new_img, const int ksz,
-                  const int begin_x, const int begin_y, const int end_x, const int end_y)
+struct MinOp { Uint8 operator()(const Uint8 a, const Uint8 b) const noexcept { return a < b ? a : b; } };
+struct MaxOp { Uint8 operator()(const Uint8 a, const Uint8 b) const noexcept { return a < b ? b : a; } };
+
+// прямоугольный структурный элемент kw x kh раскладывается на проходы по строкам и столбцам
+void ImageProc::Morphology(QImage* img, const int kw, const int kh, const bool dilate)
 {
-    Matrix<Uint8> part_r(ksz, ksz);
-    Matrix<Uint8> part_g(ksz, ksz);
-    Matrix<Uint8> part_b(ksz, ksz);
+    if(img->isNull())
+        return;
 
-    constexpr int szg = 256;
-    array<int, szg> hist_r{ 0 };
-    array<int, szg> hist_g{ 0 };
-    array<int, szg> hist_b{ 0 };
+    const int width = img->width();
+    const int height = img->height();
 
-    for (int i = begin_x; i < end_x; ++i)
-    {
-        for (int j = begin_y; j < end_y; ++j)
-        {
-            fillTmpMatrix(part_r, part_g, part_b, img, ksz, i, j);
+    if (kw % 2 == 0 || kh % 2 == 0 || kw < 1 || kh < 1 || kw > width || kh > height)
+        return;
 
-            bool is_new_s = j == 0;
+    scratch8.resize(4 * static_cast<size_t>(width) * height);
 
+    const ConstImageView src = ViewOf(*img);
+    const ImageView dst = MutableViewOf(Target(img));
 
-            new_img.setPixel(i, j, qRgb(
-                             find_max(part_r, hist_r, is_new_s),
-                             find_max(part_g, hist_g, is_new_s),
-                             find_max(part_b, hist_b, is_new_s)
-                             ));
-        }
-    }
+    if (dilate)
+        MorphologyFilter(running, src, scratch8.data(), dst, kw, kh, border, MaxOp());
+    else
+        MorphologyFilter(running, src, scratch8.data(), dst, kw, kh, border, MinOp());
+
+    Commit(img);
 }
 
-void ImageProc::Increase(QImage *img, int ksz)
+void ImageProc::Morphology(PlanarImage* img, const int kw, const int kh, const bool dilate)
 {
     if(img->isNull())
         return;
 
-    int width = img->width();
-    int height = img->height();
+    const int width = img->width();
+    const int height = img->height();
 
-    if (ksz % 2 == 0 || ksz < 3 || ksz > width || ksz > height)
+    if (kw % 2 == 0 || kh % 2 == 0 || kw < 1 || kh < 1 || kw > width || kh > height)
         return;
 
-    QImage new_img(width, height, QImage::Format_RGB32);
+    scratch8.resize(static_cast<size_t>(width) * height);
+
+    PlanarImage& out = Target(*img);
+
+    for (int c = 0; c < PlanarImage::Planes; ++c)
+    {
+        const ConstPlaneView src = img->plane(c);
+        const uchar edge = PlanarImage::channel(border.constant, c);
+
+        if (dilate)
+            MorphologyPlane(running, src, scratch8.data(), out.plane(c), kw, kh, border.mode, edge, MaxOp());
+        else
+            MorphologyPlane(running, src, scratch8.data(), out.plane(c), kw, kh, border.mode, edge, MinOp());
+    }
 
-//    Matrix<Uint8> part_r(ksz, ksz);
-//    Matrix<Uint8> part_g(ksz, ksz);
-//    Matrix<Uint8> part_b(ksz, ksz);
+    Commit(img);
+}
 
-//    const int szg = 256;
-//    array<int, szg> hist_r{ 0 };
-//    array<int, szg> hist_g{ 0 };
-//    array<int, szg> hist_b{ 0 };
+void ImageProc::Erosion(QImage *img, int ksz)
+{
+    if (ksz < 3)
+        return;
 
-//    for (int i = 0; i < width; i++)
-//    {
-//        for (int j = 0; j < height; j++)
-//        {
-//            fillTmpMatrix(part_r, part_g, part_b, img, ksz, i, j);
+    Morphology(img, ksz, ksz, false);
+}
 
-//            bool is_new_s = j == 0;
+void ImageProc::Increase(QImage *img, int ksz)
+{
+    if (ksz < 3)
+        return;
 
+    Morphology(img, ksz, ksz, true);
+}
 
-//            new_img.setPixel(i, j, qRgb(
-//                             find_max(part_r, hist_r, is_new_s),
-//                             find_max(part_g, hist_g, is_new_s),
-//                             find_max(part_b, hist_b, is_new_s)
-//                             ));
-//        }
-//    }
+void ImageProc::Erosion(PlanarImage* img, int ksz)
+{
+    if (ksz < 3)
+        return;
 
-    auto f1 = std::async(std::launch::async, IncreaseLoop, img, std::ref(new_img), ksz, 0, 0, width / 3, height);
-    auto f2 = std::async(std::launch::async, IncreaseLoop, img, std::ref(new_img), ksz, width / 3, 0, (width / 3) * 2, height);
-    auto f3 = std::async(std::launch::async, IncreaseLoop, img, std::ref(new_img), ksz, (width / 3) * 2, 0, width, height);
+    Morphology(img, ksz, ksz, false);
+}
 
-    f1.wait();
-    f2.wait();
-    f3.wait();
+void ImageProc::Increase(PlanarImage* img, int ksz)
+{
+    if (ksz < 3)
+        return;
 
-    *img = move(new_img);
+    Morphology(img, ksz, ksz, true);
 }
 
 
@@ -746,6 +1773,12 @@ void ImageProc::RotateRightGo(QImage *img)
     emit isDone();
 }
 
+void ImageProc::Rotate180Go(QImage *img)
+{
+    rotate_180(img);
+    emit isDone();
+}
+
 void ImageProc::HMirrorGo(QImage *img)
 {
     *img = img->mirrored(false, true);
@@ -776,8 +1809,56 @@ void ImageProc::GammaFuncGo(QImage *img, double c, double d)
     emit isDone();
 }
 
-void ImageProc::GaussBlurGo(QImage *img)
+void ImageProc::GaussBlurGo(QImage *img, double sigma)
 {
-    GaussBlur(img);
+    GaussBlur(img, sigma);
     emit isDone();
 }
+
+// Задания выполняются по очереди; пока выполнялось одно, следующие могли устареть -
+// такие не начинаются, а устаревшее во время выполнения прерывается. Результата они не присылают.
+void ImageProc::RenderGo(RenderJobPtr job)
+{
+    const quint64 gen = job->generation;
+
+    if (gen != generation)
+        return;
+
+    if (job->proxy.isValid() && !job->image.isNull())
+    {
+        const int width = job->image.width();
+        job->image = job->image.scaled(job->proxy, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        job->scale = static_cast<double>(job->image.width()) / width;
+    }
+
+    const double mpix = static_cast<double>(job->image.width()) * job->image.height() / 1e6;
+
+    auto cancelled = [this, gen]{ return generation != gen; };
+    auto report = [this, gen](double fraction, double mpix_per_s){ emit progress(gen, fraction, mpix_per_s); };
+    job->progress.Begin(mpix, cancelled, report);
+
+    // куски операций - через job->progress, пока задание выполняется
+    running = &job->progress;
+
+    // операция прерывается до Commit, поэтому изображение источника не меняется
+    try
+    {
+        job->graph.Execute(*this, &job->image, job->scale, running);
+    }
+    catch (const OperationCancelled&)
+    {
+        SetInputTone(nullptr);
+        running = nullptr;
+        return;
+    }
+
+    running = nullptr;
+    emit rendered(job);
+}
+
+void ImageProc::StatsGo(RenderJobPtr job)
+{
+    job->tone = job->graph.Tone(*this, &job->image);
+    job->stats = RemapStats(Stats(&job->image), job->tone);
+    emit statsReady(job);
+}
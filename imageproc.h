@@ -8,50 +8,144 @@
 #include <utility>
 #include <memory>
 #include <tuple>
+#include <array>
+#include <mutex>
+#include <atomic>
 
-#include "mycoloriterator.h"
+#include "imageview.h"
+#include "border.h"
 #include "matrix.h"
+#include "planar.h"
+#include "progress.h"
+#include "tonelut.h"
 
 using ull = unsigned long long;
 using Uint8 = unsigned char;
 
 using namespace std;
 
+//  Статистика за один проход: гистограммы каналов R, G, B и выведенные из них min, max и суммы
+struct ImageStats
+{
+    array<array<int, 256>, 3> hist;
+    array<uchar, 3> min;
+    array<uchar, 3> max;
+    array<ull, 3> sum;
+    ull count;
+};
+
+// статистика изображения после тонового преобразования, без прохода по пикселям
+ImageStats RemapStats(const ImageStats& st, const ToneLut& lut);
+
+// таблицы операций LinearCorr и GrayWorld для изображения со статистикой st
+ToneLut LinearCorrTone(const ImageStats& st);
+ToneLut GrayWorldTone(const ImageStats& st);
+
+struct RenderJob;
+using RenderJobPtr = shared_ptr<RenderJob>;
+
 class ImageProc : public QObject
 {
     Q_OBJECT
 public:
     explicit ImageProc(QObject* parent = nullptr);
 
-private:
+    // кэшируется до изменения изображения (по QImage::cacheKey), можно вызывать из любого потока
+    ImageStats Stats(const QImage* img);
+
+    // Операции синхронно меняют *img в вызывающем потоке (слоты ...Go ниже - те же операции
+    // с сигналом isDone). Один объект не рассчитан на одновременные вызовы из нескольких потоков:
+    // буферы результата у него общие.
     void rotate_left(QImage* img);
     void rotate_right(QImage* img);
+    void rotate_180(QImage* img);
 
     void GrayWorld(QImage* img);
     void LinearCorr(QImage* img);
     void GammaFunc(QImage* img, double c, double d);
-    void GaussBlur(QImage* img);
+    void GaussBlur(QImage* img, const double sigma);
     void MedianFilter(QImage* img, const int ksz);
     void CustomFilter(QImage* img, vector<double> *kernel);
+    // среднее по окну kw x kh (нечётные); ядро CustomFilter с равными весами считается так же
+    void BoxFilter(QImage* img, int kw, int kh);
     void Erosion(QImage* img, int ksz);
     void Increase(QImage* img, int ksz);
 
+    // Те же фильтры над плоскостями каналов (planar.h) для цепочек из нескольких фильтров подряд:
+    // пиксели распаковываются один раз на цепочку, а не на каждом шаге. Результат тот же.
+    void GaussBlur(PlanarImage* img, double sigma);
+    void MedianFilter(PlanarImage* img, int ksz);
+    void Erosion(PlanarImage* img, int ksz);
+    void Increase(PlanarImage* img, int ksz);
+
+    // что фильтры окрестности (свёртки, Гаусс, медиана, морфология) видят за краем изображения
+    void SetBorder(BorderMode mode, QRgb constant = qRgb(0, 0, 0));
+    Border GetBorder() const { return border; }
+
+    // Поточечное преобразование, которое фильтры окрестности применяют к пикселям при чтении
+    // (см. Border::tone): фильтр с ним даёт тот же результат, что ApplyTone и затем фильтр,
+    // без отдельного прохода по изображению. nullptr - нет; *lut должна жить до сброса.
+    void SetInputTone(const ToneLut* lut);
+
+    void ApplyTone(QImage* img, const ToneLut& lut);
+
+    // Номер последнего задания RenderGo, можно вызывать из любого потока. Задание с другим
+    // номером отменяется: ещё не начатое пропускается, выполняющееся прерывается на следующем
+    // куске (полосе строк или тайле) без результата.
+    void SetGeneration(quint64 gen) { generation = gen; }
+
+private:
+    QImage target;              // буфер результата, переиспользуется между вызовами
+    PlanarImage planar_target;  // то же для плоскостей
+    vector<float> scratch;      // промежуточный буфер сепарабельных проходов
+    vector<ushort> scratch16;   // то же в фиксированной точке
+    vector<uchar> scratch8;     // промежуточный буфер морфологии
+    Border border;
+
+    mutex stats_mutex;
+    ImageStats stats;
+    qint64 stats_key = 0;
+    bool stats_valid = false;
+
+    atomic<quint64> generation{0};
+    OpProgress* running = nullptr;  // ход задания RenderGo, которое сейчас выполняется; вне задания - nullptr
+
+    QImage& Target(const QImage* img);
+    QImage& Target(const QSize& size);
+    void Commit(QImage* img);
+    PlanarImage& Target(const PlanarImage& img);
+    void Commit(PlanarImage* img);
+
+    void Rotate(QImage* img, const bool clockwise);
+    void Morphology(QImage* img, const int kw, const int kh, const bool dilate);
+    void Morphology(PlanarImage* img, const int kw, const int kh, const bool dilate);
+
 signals:
     void isDone();
+    void rendered(RenderJobPtr job);
+    // ход задания RenderGo с номером generation: доля выполненного и скорость, Мпикс/с
+    void progress(quint64 generation, double fraction, double mpix_per_s);
+    void statsReady(RenderJobPtr job);
 
 public slots:
     void GrayWorldGo(QImage* img);
     void LinearCorrGo(QImage* img);
     void GammaFuncGo(QImage* img, double c, double d);
-    void GaussBlurGo(QImage* img);
+    void GaussBlurGo(QImage* img, double sigma);
     void MedianFilterGo(QImage* img, const int ksz);
     void CustomFilterGo(QImage* img, vector<double>* kernel);
     void ErosionGo(QImage* img, int ksz);
     void IncreaseGo(QImage* img, int ksz);
     void RotateLeftGo(QImage* img);
     void RotateRightGo(QImage* img);
+    void Rotate180Go(QImage* img);
     void HMirrorGo(QImage* img);
     void VMirrorGo(QImage* img);
+    void RenderGo(RenderJobPtr job);
+    // job->tone - таблица поточечных операций graph для image (для предпросмотра), job->stats -
+    // статистика image после неё (для гистограммы), затем statsReady. Статистика кэшируется
+    // и переиспользуется заданиями RenderGo над тем же изображением.
+    void StatsGo(RenderJobPtr job);
 };
 
 #endif // IMAGEPROC_H
@@ -0,0 +1,84 @@
+#ifndef IMAGEVIEW_H
+#define IMAGEVIEW_H
+
+#include <QImage>
+#include <QRgb>
+
+#include <cstddef>
+#include <type_traits>
+
+//  Окно в чужой буфер пикселей RGB32: указатель на первую строку, размеры и шаг строки в байтах
+//  (у QImage строки выровнены, шаг может быть больше 4 * width). Буфером не владеет, копируется
+//  бесплатно, поэтому одно изображение можно раздать нескольким потокам и этапам без копий.
+//  Pixel - QRgb (ImageView, запись) или const QRgb (ConstImageView, только чтение);
+//  uchar - одна плоскость PlanarImage (PlaneView, ConstPlaneView).
+template<typename Pixel>
+class BasicImageView
+{
+public:
+    using Byte = typename std::conditional<std::is_const<Pixel>::value, const uchar, uchar>::type;
+
+    BasicImageView() = default;
+
+    BasicImageView(Byte* data, const int width, const int height, const int stride,
+                   const QImage::Format format = QImage::Format_RGB32) noexcept
+        : data(data), w(width), h(height), step(stride), fmt(format) {}
+
+    // ImageView -> ConstImageView
+    template<typename Other, typename = typename std::enable_if<
+                 !std::is_same<Other, Pixel>::value && std::is_same<const Other, Pixel>::value>::type>
+    BasicImageView(const BasicImageView<Other>& other) noexcept
+        : data(other.bits()), w(other.width()), h(other.height()), step(other.stride()), fmt(other.format()) {}
+
+    int width() const noexcept { return w; }
+    int height() const noexcept { return h; }
+    int stride() const noexcept { return step; }
+    QImage::Format format() const noexcept { return fmt; }
+    bool isNull() const noexcept { return data == nullptr || w <= 0 || h <= 0; }
+
+    // строки идут подряд без выравнивания - весь буфер можно обойти одним куском
+    bool contiguous() const noexcept { return step == static_cast<int>(sizeof(Pixel)) * w; }
+
+    Byte* bits() const noexcept { return data; }
+
+    Pixel* line(const int y) const noexcept
+    {
+        return reinterpret_cast<Pixel*>(data + static_cast<std::ptrdiff_t>(y) * step);
+    }
+
+    Pixel& at(const int x, const int y) const noexcept { return line(y)[x]; }
+
+    // строки [y0, y1) как отдельное окно (его строка 0 - строка y0) - кусок для потока или тайл
+    BasicImageView rows(const int y0, const int y1) const noexcept
+    {
+        return BasicImageView(data + static_cast<std::ptrdiff_t>(y0) * step, w, y1 - y0, step, fmt);
+    }
+
+private:
+    Byte* data = nullptr;
+    int w = 0;
+    int h = 0;
+    int step = 0;
+    QImage::Format fmt = QImage::Format_RGB32;
+};
+
+using ImageView = BasicImageView<QRgb>;
+using ConstImageView = BasicImageView<const QRgb>;
+using PlaneView = BasicImageView<uchar>;
+using ConstPlaneView = BasicImageView<const uchar>;
+
+// только чтение: constBits() не отсоединяет данные, разделяемые с другими копиями QImage
+inline ConstImageView ViewOf(const QImage& img) noexcept
+{
+    return ConstImageView(img.constBits(), img.width(), img.height(), img.bytesPerLine(), img.format());
+}
+
+// Запись: bits() отсоединяет данные, если они разделяемые (иначе изменились бы и другие копии).
+// Буферы результата ImageProc никогда не разделяются, для них копии не бывает.
+inline ImageView MutableViewOf(QImage& img)
+{
+    uchar* data = img.bits();
+    return ImageView(data, img.width(), img.height(), img.bytesPerLine(), img.format());
+}
+
+#endif // IMAGEVIEW_H
@@ -25,6 +25,7 @@ MainWindow::MainWindow(QWidget *parent) :
 
     inMtx = new InputMatrix(this);
     imgProc.reset(new ImageProc());
+    viewProc.reset(new ImageProc());
     MyThread = new QThread(this);
 
     connect(this, SIGNAL(destroyed()), MyThread, SLOT(quit()));
@@ -39,19 +40,17 @@ MainWindow::MainWindow(QWidget *parent) :
 
     ui->RotateLeftBtn->setDisabled(true);
     ui->RotateLeftBtn->setIcon(QIcon(":rotateLeft"));
-    connect(this, SIGNAL(RotateLeftStart(QImage*)), imgProc.data(), SLOT(RotateLeftGo(QImage*)));
 
     ui->RotateRightBtn->setDisabled(true);
     ui->RotateRightBtn->setIcon(QIcon(":rotateRight"));
-    connect(this, SIGNAL(RotateRightStart(QImage*)), imgProc.data(), SLOT(RotateRightGo(QImage*)));
+
+    ui->Rotate180Btn->setDisabled(true);
 
     ui->HMirroredBtn->setDisabled(true);
     ui->HMirroredBtn->setIcon(QIcon(":HMirror"));
-    connect(this, SIGNAL(HMirrorStart(QImage*)), imgProc.data(), SLOT(HMirrorGo(QImage*)));
 
     ui->VMirroredBtn->setDisabled(true);
     ui->VMirroredBtn->setIcon(QIcon(":VMirror"));
-    connect(this, SIGNAL(VMirrorStart(QImage*)), imgProc.data(), SLOT(VMirrorGo(QImage*)));
 
     ui->PrevBtn->setDisabled(true);
     ui->PrevBtn->setIcon(QIcon(":Prev"));
@@ -60,10 +59,8 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->NextBtn->setIcon(QIcon(":Next"));
 
     ui->LinCorrBtn->setDisabled(true);
-    connect(this, SIGNAL(LinCorrStart(QImage*)), imgProc.data(), SLOT(LinearCorrGo(QImage*)));
 
     ui->GrayWorldBtn->setDisabled(true);
-    connect(this, SIGNAL(GrayWorldStart(QImage*)), imgProc.data(), SLOT(GrayWorldGo(QImage*)));
 
     ui->GammaBtn->setDisabled(true);
     ui->GammaLabel_1->hide();
@@ -74,10 +71,12 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->GammaDSpinBox_2->setMinimum(1);
     ui->GammaOk->setDisabled(true);
     ui->GammaOk->hide();
-    connect(this, SIGNAL(GammaStart(QImage*,double,double)), imgProc.data(), SLOT(GammaFuncGo(QImage*,double,double)));
 
     ui->GBOkBtn->setDisabled(true);
-    connect(this, SIGNAL(GBStart(QImage*)), imgProc.data(), SLOT(GaussBlurGo(QImage*)));
+    ui->GBSigmaSpinBox->setDisabled(true);
+    ui->GBSigmaSpinBox->setRange(0.3, 50.0);
+    ui->GBSigmaSpinBox->setSingleStep(0.5);
+    ui->GBSigmaSpinBox->setValue(0.84);
 
     ui->MedianBtn->setDisabled(true);
     ui->MedianLabel_1->hide();
@@ -85,10 +84,8 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->MedianSBox->setRange(3, 63);
     ui->MedianSBox->setSingleStep(2);
     ui->MedianOkBtn->hide();
-    connect(this, SIGNAL(MedianStart(QImage*,int)), imgProc.data(), SLOT(MedianFilterGo(QImage*,int)));
 
     ui->CustomBtn->setDisabled(true);
-    connect(this, SIGNAL(CustomStart(QImage*, vector<double>*)), imgProc.data(), SLOT(CustomFilterGo(QImage*, vector<double>*)));
 
     ui->ErosionRadioBtn->setDisabled(true);
     ui->ErosionSpinBox->setRange(3, 63);
@@ -96,7 +93,6 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->ErosionLabel->hide();
     ui->ErosionSpinBox->hide();
     ui->ErosionOkBtn->hide();
-    connect(this, SIGNAL(ErosionStart(QImage*,int)), imgProc.data(), SLOT(ErosionGo(QImage*,int)));
 
     ui->IncreaseRadioBtn->setDisabled(true);
     ui->IncreaseSpinBox->setRange(3, 63);
@@ -104,11 +100,16 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->IncreaseLabel->hide();
     ui->IncreaseSpinBox->hide();
     ui->IncreaseOkBtn->hide();
-    connect(this, SIGNAL(IncreaseStart(QImage*,int)), imgProc.data(), SLOT(IncreaseGo(QImage*,int)));
 
     connect(inMtx, SIGNAL(valuesChecked()), this, SLOT(CustomMatrix()));
 
+    qRegisterMetaType<RenderJobPtr>("RenderJobPtr");
+    connect(this, SIGNAL(RenderStart(RenderJobPtr)), imgProc.data(), SLOT(RenderGo(RenderJobPtr)));
+    connect(imgProc.data(), SIGNAL(rendered(RenderJobPtr)), this, SLOT(RenderIsDone(RenderJobPtr)));
     connect(imgProc.data(), SIGNAL(isDone()), this, SLOT(ProcIsDone()));
+    connect(imgProc.data(), SIGNAL(progress(quint64,double,double)), this, SLOT(ProgressChanged(quint64,double,double)));
+    connect(this, SIGNAL(StatsStart(RenderJobPtr)), imgProc.data(), SLOT(StatsGo(RenderJobPtr)));
+    connect(imgProc.data(), SIGNAL(statsReady(RenderJobPtr)), this, SLOT(StatsIsDone(RenderJobPtr)));
 
     ui->HistogramBtn->setDisabled(true);
 
@@ -130,8 +131,54 @@ void MainWindow::update_pixmap()
     if(MyIMG->isNull())
         return;
 
-    QPixmap pm = QPixmap::fromImage(*MyIMG);
-    ui->label->setPixmap(pm.scaled(ui->label->width(), ui->label->height(), Qt::KeepAspectRatio));
+    const QSize size = MyIMG->size().scaled(ui->label->size(), Qt::KeepAspectRatio);
+
+    // результат из MyThread: уменьшенная копия уже нужного размера, полный - уменьшается
+    if(!rendered.isNull())
+    {
+        ui->label->setPixmap(QPixmap::fromImage(rendered.size() == size ? rendered : rendered.scaled(size)));
+        return;
+    }
+
+    // уменьшенный MyIMG пересчитывается только при изменении изображения или размера label
+    if(display.size() != size || display_key != MyIMG->cacheKey())
+    {
+        display = MyIMG->scaled(size);
+        display_key = MyIMG->cacheKey();
+    }
+
+    // Масштабирование без сглаживания только выбирает пиксели, поэтому отложенные поточечные
+    // операции можно применить к уменьшенной копии - показанное совпадает с результатом
+    QImage img = display;
+
+    if(!shown.isEmpty())
+    {
+        // LinearCorr и GrayWorld нужна статистика MyIMG: таблицу считает MyThread (StatsGo),
+        // статистика остаётся там в кэше для выполнения графа. До ответа картинка прежняя
+        if(shown.needsStats())
+        {
+            if(!tone_job || tone_job->generation != generation || tone_job->image.cacheKey() != MyIMG->cacheKey())
+            {
+                tone_job = make_shared<RenderJob>();
+                tone_job->generation = generation;
+                tone_job->graph = shown;
+                tone_job->image = *MyIMG;
+                tone_ready = false;
+
+                emit StatsStart(tone_job);
+                return;
+            }
+
+            if(!tone_ready)
+                return;
+
+            viewProc->ApplyTone(&img, tone_job->tone);
+        }
+        else
+            viewProc->ApplyTone(&img, shown.Tone(*viewProc, MyIMG.data()));
+    }
+
+    ui->label->setPixmap(QPixmap::fromImage(img));
 }
 
 bool MainWindow::loadImage(const QString &str)
@@ -139,6 +186,8 @@ bool MainWindow::loadImage(const QString &str)
     if(!MyIMG->load(str))
         return false;
 
+    ResetPreview();
+
     *MyIMG = MyIMG->convertToFormat(QImage::Format_RGB32);
     *TmpIMG = *MyIMG;
     update_pixmap();
@@ -155,6 +204,7 @@ void MainWindow::EnableAll(bool flag)
     ui->GammaBtn->setEnabled(flag);
     ui->GammaOk->setEnabled(flag);
     ui->GBOkBtn->setEnabled(flag);
+    ui->GBSigmaSpinBox->setEnabled(flag);
     ui->GrayWorldBtn->setEnabled(flag);
     ui->IncreaseRadioBtn->setEnabled(flag);
     ui->IncreaseOkBtn->setEnabled(flag);
@@ -170,6 +220,7 @@ void MainWindow::EnableAll(bool flag)
     ui->PrevBtn->setEnabled(flag);
     ui->RotateLeftBtn->setEnabled(flag);
     ui->RotateRightBtn->setEnabled(flag);
+    ui->Rotate180Btn->setEnabled(flag);
     ui->VMirroredBtn->setEnabled(flag);
     ui->QuickSaveBtn->setEnabled(flag);
 }
@@ -178,6 +229,182 @@ void MainWindow::StartProcess()
 {
     ui->ProgressLabel->setText("Обработка...");
     EnableAll(false);
+    ui->CancelBtn->setEnabled(true);
+}
+
+// Отмена принимаемой операции: её задание прерывается (SetGeneration), MyIMG и pending не меняются
+void MainWindow::AbortProcess()
+{
+    imgProc->SetGeneration(++generation);
+
+    shown = pending;
+    rendered = QImage();
+    rendered_full = false;
+    commit_pending = false;
+    preview_op = Preview::None;
+    after_flush = nullptr;
+
+    EnableAll(true);
+    update_pixmap();
+    ui->ProgressLabel->setText("Отменено");
+}
+
+RenderJobPtr MainWindow::NewJob(const QSize& proxy) const
+{
+    RenderJobPtr job = make_shared<RenderJob>();
+    job->generation = generation;
+    job->graph = shown;
+    job->image = *MyIMG;
+    job->proxy = proxy;
+    return job;
+}
+
+// Показывает результат graph над MyIMG, не меняя MyIMG. Только поточечные операции - сразу,
+// таблицей по уменьшенной копии. Иначе в MyThread: сначала по копии размером с label (видна сразу),
+// затем в полном разрешении. Новый предпросмотр отменяет ещё не начатые задания старого.
+void MainWindow::ShowPreview(const OpGraph& graph, const Preview op)
+{
+    if(MyIMG->isNull() || commit_pending)
+        return;
+
+    shown = graph;
+    rendered = QImage();
+    rendered_full = false;
+    preview_op = op;
+    imgProc->SetGeneration(++generation);
+
+    if(shown.isToneOnly())
+    {
+        update_pixmap();
+        return;
+    }
+
+    ui->ProgressLabel->setText("Предпросмотр...");
+
+    if(MyIMG->width() > ui->label->width() || MyIMG->height() > ui->label->height())
+        emit RenderStart(NewJob(ui->label->size()));
+
+    emit RenderStart(NewJob(QSize()));
+}
+
+// Принимает graph: если это операция, предпросмотр которой сейчас показан, - без пересчёта.
+// Поточечные операции остаются отложенными (pending) до операции другого вида или сохранения.
+void MainWindow::Apply(const OpGraph& graph, const Preview op)
+{
+    if(op == Preview::Other || op != preview_op)
+        ShowPreview(graph, op);
+
+    if(shown.isToneOnly())
+    {
+        pending = shown;
+        preview_op = Preview::None;
+        ui->ProgressLabel->setText("Готово");
+        return;
+    }
+
+    if(rendered_full)
+    {
+        Adopt();
+        return;
+    }
+
+    commit_pending = true;
+    StartProcess();
+}
+
+void MainWindow::Adopt()
+{
+    *MyIMG = rendered;
+    pending.clear();
+    shown.clear();
+    rendered = QImage();
+    rendered_full = false;
+    commit_pending = false;
+    preview_op = Preview::None;
+
+    ProcIsDone();
+
+    if(after_flush)
+    {
+        const function<void()> then = move(after_flush);
+        after_flush = nullptr;
+        then();
+    }
+}
+
+void MainWindow::ResetPreview()
+{
+    pending.clear();
+    shown.clear();
+    rendered = QImage();
+    rendered_full = false;
+    commit_pending = false;
+    preview_op = Preview::None;
+    after_flush = nullptr;
+    hist_job.reset();
+    imgProc->SetGeneration(++generation);
+}
+
+// Отложенные поточечные операции - в пиксели MyIMG (перед сохранением), затем then; предпросмотр
+// сбрасывается. Граф выполняется в MyThread как принимаемая операция: новый номер отменяет задания
+// предпросмотра, а then вызывается из Adopt, когда придёт результат.
+void MainWindow::Flush(function<void()> then)
+{
+    if(pending.isEmpty())
+    {
+        ResetPreview();
+        update_pixmap();
+        then();
+        return;
+    }
+
+    shown = pending;
+    rendered = QImage();
+    rendered_full = false;
+    preview_op = Preview::None;
+    imgProc->SetGeneration(++generation);
+
+    after_flush = move(then);
+    commit_pending = true;
+    StartProcess();
+
+    emit RenderStart(NewJob(QSize()));
+}
+
+void MainWindow::RenderIsDone(RenderJobPtr job)
+{
+    if(job->generation != generation)
+        return;
+
+    rendered = job->image;
+
+    if(job->proxy.isValid())
+    {
+        update_pixmap();
+        return;
+    }
+
+    rendered_full = true;
+
+    if(commit_pending)
+    {
+        Adopt();
+        return;
+    }
+
+    update_pixmap();
+    ui->ProgressLabel->setText("Предпросмотр готов");
+}
+
+void MainWindow::ProgressChanged(quint64 gen, double fraction, double mpix)
+{
+    if(gen != generation)
+        return;
+
+    ui->ProgressLabel->setText(QString("%1 %2% (%3 Мпикс/с)")
+                               .arg(commit_pending ? "Обработка..." : "Предпросмотр...")
+                               .arg(qRound(fraction * 100))
+                               .arg(mpix, 0, 'f', 1));
 }
 
 void MainWindow::on_SaveBtn_clicked()
@@ -187,8 +414,10 @@ void MainWindow::on_SaveBtn_clicked()
     if(fileName.isEmpty())
         return;
 
-    MyIMG->save(fileName);
-    ui->ProgressLabel->setText("Сохранено");
+    Flush([this, fileName]{
+        MyIMG->save(fileName);
+        ui->ProgressLabel->setText("Сохранено");
+    });
 }
 
 void MainWindow::on_LoadBtn_clicked()
@@ -219,6 +448,13 @@ void MainWindow::on_LoadBtn_clicked()
 
 void MainWindow::on_CancelBtn_clicked()
 {
+    if(commit_pending)
+    {
+        AbortProcess();
+        return;
+    }
+
+    ResetPreview();
     *MyIMG = *TmpIMG;
     update_pixmap();
     ui->CancelBtn->setDisabled(true);
@@ -227,14 +463,16 @@ void MainWindow::on_CancelBtn_clicked()
 
 void MainWindow::on_LinCorrBtn_clicked()
 {
-    StartProcess();
-    emit LinCorrStart(MyIMG.data());
+    OpGraph graph = pending;
+    graph.LinearCorr();
+    Apply(graph, Preview::Other);
 }
 
 void MainWindow::on_GrayWorldBtn_clicked()
 {
-    StartProcess();
-    emit GrayWorldStart(MyIMG.data());
+    OpGraph graph = pending;
+    graph.GrayWorld();
+    Apply(graph, Preview::Other);
 }
 
 void MainWindow::on_GammaBtn_toggled(bool checked)
@@ -261,23 +499,41 @@ void MainWindow::on_GammaBtn_toggled(bool checked)
 void MainWindow::on_GammaDSpinBox_1_valueChanged(double arg1)
 {
      ui->GammaOk->setEnabled(arg1 != 1.0);
+     PreviewGamma();
 }
 
 void MainWindow::on_GammaDSpinBox_2_valueChanged(double arg1)
 {
     ui->GammaOk->setEnabled(arg1 != 1.0);
+    PreviewGamma();
+}
+
+void MainWindow::PreviewGamma()
+{
+    OpGraph graph = pending;
+    graph.Gamma(ui->GammaDSpinBox_1->value(), ui->GammaDSpinBox_2->value());
+    ShowPreview(graph, Preview::Gamma);
+}
+
+void MainWindow::on_GBSigmaSpinBox_valueChanged(double arg1)
+{
+    OpGraph graph = pending;
+    graph.GaussBlur(arg1);
+    ShowPreview(graph, Preview::Gauss);
 }
 
 void MainWindow::on_GammaOk_clicked()
 {
-    StartProcess();
-    emit GammaStart(MyIMG.data(), ui->GammaDSpinBox_1->value(), ui->GammaDSpinBox_2->value());
+    OpGraph graph = pending;
+    graph.Gamma(ui->GammaDSpinBox_1->value(), ui->GammaDSpinBox_2->value());
+    Apply(graph, Preview::Gamma);
 }
 
 void MainWindow::on_GBOkBtn_clicked()
 {
-    StartProcess();
-    emit GBStart(MyIMG.data());
+    OpGraph graph = pending;
+    graph.GaussBlur(ui->GBSigmaSpinBox->value());
+    Apply(graph, Preview::Gauss);
 }
 
 void MainWindow::on_MedianBtn_toggled(bool checked)
@@ -304,19 +560,28 @@ void MainWindow::ProcIsDone()
 
 void MainWindow::on_MedianOkBtn_clicked()
 {
-    StartProcess();
-    emit MedianStart(MyIMG.data(), ui->MedianSBox->value());
+    OpGraph graph = pending;
+    graph.MedianFilter(ui->MedianSBox->value());
+    Apply(graph, Preview::Median);
 }
 
 void MainWindow::on_MedianSBox_valueChanged(int arg1)
 {
     ui->MedianOkBtn->setEnabled(arg1 % 2);
+
+    if(arg1 % 2)
+    {
+        OpGraph graph = pending;
+        graph.MedianFilter(arg1);
+        ShowPreview(graph, Preview::Median);
+    }
 }
 
 void MainWindow::CustomMatrix()
 {
-    StartProcess();
-    emit CustomStart(MyIMG.data(), inMtx->getValuesPtr());
+    OpGraph graph = pending;
+    graph.CustomFilter(*inMtx->getValuesPtr());
+    Apply(graph, Preview::Other);
 }
 
 void MainWindow::on_CustomBtn_clicked()
@@ -335,8 +600,9 @@ void MainWindow::on_Quit_clicked()
 
 void MainWindow::on_ErosionOkBtn_clicked()
 {
-    StartProcess();
-    emit ErosionStart(MyIMG.data(), ui->ErosionSpinBox->value());
+    OpGraph graph = pending;
+    graph.Erosion(ui->ErosionSpinBox->value());
+    Apply(graph, Preview::Erosion);
 }
 
 void MainWindow::on_ErosionRadioBtn_toggled(bool checked)
@@ -357,12 +623,20 @@ void MainWindow::on_ErosionRadioBtn_toggled(bool checked)
 void MainWindow::on_ErosionSpinBox_valueChanged(int arg1)
 {
     ui->ErosionOkBtn->setEnabled(arg1 && arg1 % 2);
+
+    if(arg1 % 2)
+    {
+        OpGraph graph = pending;
+        graph.Erosion(arg1);
+        ShowPreview(graph, Preview::Erosion);
+    }
 }
 
 void MainWindow::on_IncreaseOkBtn_clicked()
 {
-    StartProcess();
-    emit IncreaseStart(MyIMG.data(), ui->ErosionSpinBox->value());
+    OpGraph graph = pending;
+    graph.Increase(ui->IncreaseSpinBox->value());
+    Apply(graph, Preview::Increase);
 }
 
 void MainWindow::on_IncreaseRadioBtn_toggled(bool checked)
@@ -383,52 +657,82 @@ void MainWindow::on_IncreaseRadioBtn_toggled(bool checked)
 void MainWindow::on_IncreaseSpinBox_valueChanged(int arg1)
 {
     ui->IncreaseOkBtn->setEnabled(arg1 && arg1 % 2);
+
+    if(arg1 % 2)
+    {
+        OpGraph graph = pending;
+        graph.Increase(arg1);
+        ShowPreview(graph, Preview::Increase);
+    }
 }
 
+// статистика считается в MyThread (там же она кэшируется), окно гистограммы открывает StatsIsDone
 void MainWindow::on_HistogramBtn_clicked()
 {
-    array<int, 256> arr_valsRed = { 0 };
-    array<int, 256> arr_valsGreen = { 0 };
-    array<int, 256> arr_valsBlue = { 0 };
+    if(MyIMG->isNull() || hist_job)
+        return;
 
+    hist_job = make_shared<RenderJob>();
+    hist_job->graph = pending;
+    hist_job->image = *MyIMG;
 
-    auto Cfirst = ConstMyColorIterator::CBegin(*MyIMG);
-    auto Clast = ConstMyColorIterator::CEnd(*MyIMG);
+    emit StatsStart(hist_job);
+}
 
-    for(; Cfirst != Clast; ++Cfirst)
+void MainWindow::StatsIsDone(RenderJobPtr job)
+{
+    if(job == tone_job)
     {
-        arr_valsRed[Cfirst.red()]++;
-        arr_valsGreen[Cfirst.green()]++;
-        arr_valsBlue[Cfirst.blue()]++;
+        tone_ready = true;
+        update_pixmap();
+        return;
     }
 
-    Histogram* hist = new Histogram(arr_valsRed, arr_valsGreen, arr_valsBlue, this);
+    if(job != hist_job)
+        return;
+
+    hist_job.reset();
+
+    const ImageStats& st = job->stats;
+
+    Histogram* hist = new Histogram(st.hist[0], st.hist[1], st.hist[2], this);
 
     hist->show();
 }
 
 void MainWindow::on_RotateLeftBtn_clicked()
 {
-    StartProcess();
-    emit RotateLeftStart(MyIMG.data());
+    OpGraph graph = pending;
+    graph.RotateLeft();
+    Apply(graph, Preview::Other);
 }
 
 void MainWindow::on_RotateRightBtn_clicked()
 {
-    StartProcess();
-    emit RotateRightStart(MyIMG.data());
+    OpGraph graph = pending;
+    graph.RotateRight();
+    Apply(graph, Preview::Other);
+}
+
+void MainWindow::on_Rotate180Btn_clicked()
+{
+    OpGraph graph = pending;
+    graph.Rotate180();
+    Apply(graph, Preview::Other);
 }
 
 void MainWindow::on_HMirroredBtn_clicked()
 {
-    StartProcess();
-    emit HMirrorStart(MyIMG.data());
+    OpGraph graph = pending;
+    graph.MirrorH();
+    Apply(graph, Preview::Other);
 }
 
 void MainWindow::on_VMirroredBtn_clicked()
 {
-    StartProcess();
-    emit VMirrorStart(MyIMG.data());
+    OpGraph graph = pending;
+    graph.MirrorV();
+    Apply(graph, Preview::Other);
 }
 
 bool isImageFormat(const QString& str)
@@ -502,8 +806,12 @@ void MainWindow::on_QuickSaveBtn_clicked()
     if(MyIMG->isNull() || CurrFileIt == CurrFileList->end())
         return;
 
-    MyIMG->save(*CurrFileIt);
-    *TmpIMG = *MyIMG;
-    ui->CancelBtn->setDisabled(true);
-    ui->ProgressLabel->setText("Сохранено");
+    const QString fileName = *CurrFileIt;
+
+    Flush([this, fileName]{
+        MyIMG->save(fileName);
+        *TmpIMG = *MyIMG;
+        ui->CancelBtn->setDisabled(true);
+        ui->ProgressLabel->setText("Сохранено");
+    });
 }
@@ -16,6 +16,7 @@
 #include <QFileInfo>
 
 #include <array>
+#include <functional>
 #include <memory>
 #include <utility>
 
@@ -23,6 +24,7 @@
 #include "inputmatrix.h"
 #include "matrix.h"
 #include "histogram.h"
+#include "opgraph.h"
 
 using namespace std;
 
@@ -50,6 +52,7 @@ private slots:
     void on_GammaDSpinBox_1_valueChanged(double arg1);
     void on_GammaDSpinBox_2_valueChanged(double arg1);
     void on_GammaOk_clicked();
+    void on_GBSigmaSpinBox_valueChanged(double arg1);
     void on_GBOkBtn_clicked();
     void on_MedianBtn_toggled(bool checked);
     void on_MedianOkBtn_clicked();
@@ -61,6 +64,7 @@ private slots:
     void on_HistogramBtn_clicked();
     void on_RotateLeftBtn_clicked();
     void on_RotateRightBtn_clicked();
+    void on_Rotate180Btn_clicked();
     void on_HMirroredBtn_clicked();
     void on_VMirroredBtn_clicked();
     void on_PrevBtn_clicked();
@@ -75,9 +79,28 @@ private:
     QStringList::iterator CurrFileIt;
 
     InputMatrix* inMtx;
-    QScopedPointer<ImageProc> imgProc;
+    QScopedPointer<ImageProc> imgProc;     // в MyThread: из потока окна - только задания и SetGeneration
+    QScopedPointer<ImageProc> viewProc;    // поточечные операции над уменьшенной копией в потоке окна, без статистики
     QThread* MyThread;
 
+    // операция, параметры которой подбираются: её предпросмотр можно принять без пересчёта
+    enum class Preview { None, Other, Gamma, Gauss, Median, Erosion, Increase };
+
+    OpGraph pending;               // отложенные поточечные операции над MyIMG
+    OpGraph shown;                 // показанный результат: pending и операция предпросмотра
+    QImage rendered;               // результат shown из MyThread; пусто - shown показывается через Tone
+    bool rendered_full = false;    // rendered - полное разрешение, а не уменьшенная копия
+    bool commit_pending = false;   // принять shown в MyIMG, когда придёт полное разрешение
+    Preview preview_op = Preview::None;
+    quint64 generation = 0;        // номер предпросмотра, результаты старых не показываются
+    function<void()> after_flush;  // продолжение Flush (сохранение), когда MyIMG примет результат
+    RenderJobPtr hist_job;         // статистика для гистограммы, которая считается в MyThread
+    RenderJobPtr tone_job;         // таблица shown, которой нужна статистика MyIMG: считается в MyThread
+    bool tone_ready = false;       // ответ на tone_job пришёл
+
+    QImage display;                // MyIMG, уменьшенный до размера label
+    qint64 display_key = 0;
+
 
     virtual void resizeEvent(QResizeEvent* e) override;
 
@@ -85,6 +108,14 @@ private:
     bool loadImage(const QString& str);
     void EnableAll(bool flag);
     void StartProcess();
+    void AbortProcess();
+    void ShowPreview(const OpGraph& graph, Preview op);
+    void PreviewGamma();
+    void Apply(const OpGraph& graph, Preview op);
+    void Adopt();
+    void ResetPreview();
+    void Flush(function<void()> then);
+    RenderJobPtr NewJob(const QSize& proxy) const;
 
 private slots:
     void CustomMatrix();
@@ -93,20 +124,13 @@ private slots:
     void on_IncreaseSpinBox_valueChanged(int arg1);
     void on_ErosionSpinBox_valueChanged(int arg1);
     void ProcIsDone();
+    void RenderIsDone(RenderJobPtr job);
+    void ProgressChanged(quint64 gen, double fraction, double mpix);
+    void StatsIsDone(RenderJobPtr job);
 
 signals:
-    void LinCorrStart(QImage*);
-    void GrayWorldStart(QImage*);
-    void GammaStart(QImage*, double, double);
-    void GBStart(QImage*);
-    void MedianStart(QImage*, const int);
-    void CustomStart(QImage*, vector<double>*);
-    void ErosionStart(QImage*, const int);
-    void IncreaseStart(QImage*, const int);
-    void RotateLeftStart(QImage*);
-    void RotateRightStart(QImage*);
-    void HMirrorStart(QImage*);
-    void VMirrorStart(QImage*);
+    void RenderStart(RenderJobPtr);
+    void StatsStart(RenderJobPtr);
 };
 
 #endif // MAINWINDOW_H
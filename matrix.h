@@ -5,6 +5,12 @@
 #include<exception>
 #include<stdexcept>
 #include<string>
+#include<algorithm>
+#include<iterator>
+#include<memory>
+#include<cstddef>
+#include<cstdint>
+#include<new>
 
 using Index = long;
 
@@ -137,11 +143,87 @@ T Clamp(T& x, const T& lo, const T& hi)
 }
 
 
+namespace matrix_detail {
+
+// выравнивание буфера Matrix: строка кэша, подходит и для AVX-загрузок
+constexpr std::size_t Align = 64;
+
+// operator new до C++17 не умеет выравнивать сильнее alignof(max_align_t),
+// поэтому выделяем с запасом и храним исходный указатель перед выровненным блоком
+inline void* allocate(const std::size_t bytes)
+{
+    void* raw = ::operator new(bytes + Align + sizeof(void*));
+    const std::uintptr_t p = (reinterpret_cast<std::uintptr_t>(raw) + sizeof(void*) + Align - 1) & ~(std::uintptr_t(Align) - 1);
+
+    reinterpret_cast<void**>(p)[-1] = raw;
+    return reinterpret_cast<void*>(p);
+}
+
+inline void deallocate(void* p) noexcept
+{
+    if (p)
+        ::operator delete(reinterpret_cast<void**>(p)[-1]);
+}
+
+template<typename T>
+inline void destroy(T* first, T* last) noexcept
+{
+    for (; first != last; ++first)
+        first->~T();
+}
+
+// T() в сырой памяти [first, last); при исключении уже созданные элементы разрушаются
+template<typename T>
+inline void construct_default(T* first, T* last)
+{
+    T* cur = first;
+    try {
+        for (; cur != last; ++cur)
+            ::new (static_cast<void*>(cur)) T();
+    }
+    catch (...) {
+        destroy(first, cur);
+        throw;
+    }
+}
+
+// std::uninitialized_move есть только с C++17. Перемещение - только если оно noexcept,
+// иначе копия: тогда при исключении исходный блок остаётся целым
+template<typename T>
+inline T* uninitialized_move_if_noexcept(T* first, T* last, T* dest)
+{
+    T* cur = dest;
+    try {
+        for (; first != last; ++first, ++cur)
+            ::new (static_cast<void*>(cur)) T(std::move_if_noexcept(*first));
+    }
+    catch (...) {
+        destroy(dest, cur);
+        throw;
+    }
+    return cur;
+}
+
+// число элементов контейнера (std::size появился только в C++17, а член size() его бы скрыл)
+template<class Container>
+inline Index length(const Container& cont)
+{
+    return static_cast<Index>(std::distance(std::begin(cont), std::end(cont)));
+}
+
+}
+
+//  Матрица на куче. Элементы лежат одним выровненным блоком по строкам без промежутков
+//  (шаг строки stride() == size_dim2()), поэтому итератор - обычный указатель, а всю матрицу
+//  или строку можно обходить как непрерывный массив. Ёмкость space_d1 x space_d2 задаёт
+//  размер блока: пока новые размеры в неё укладываются, перевыделения нет. Сконструированы
+//  только живые элементы [0, size()), остаток блока - сырая память. При добавлении строк
+//  и столбцов ёмкость растёт вдвое, элементы переносятся перемещением, если оно noexcept.
 template<typename T>
 class Matrix
 {
 private:
-    T * * data{nullptr};
+    T* buf{nullptr};
     Index dm1{0};
     Index dm2{0};
     Index sz{0};
@@ -162,62 +244,101 @@ private:
             throw Matrix_error("range error");
     }
 
-public:
-    explicit Matrix(Index x = 0, Index y = 0) : dm1(x), dm2(y), sz(dm1 * dm2), space_d1(dm1), space_d2(dm2)
+    // сырой выровненный блок на count элементов
+    static T* allocate(const Index count)
     {
-        if (dm1 < 0 || dm2 < 0)
-            throw Matrix_error("Invalid argument for Matrix<T>::Matrix(Index, Index)");
+        if (count == 0)
+            return nullptr;
 
-        if(dm1 == 0) return;
+        return static_cast<T*>(matrix_detail::allocate(static_cast<std::size_t>(count) * sizeof(T)));
+    }
 
-        //cout << "Выделение памяти при помощи new в конструкторе" << endl;
+    void release() noexcept
+    {
+        matrix_detail::destroy(buf, buf + sz);
+        matrix_detail::deallocate(buf);
+    }
 
-        data = new T*[dm1];
+    // новый блок на n1 x n2, живые элементы переносятся в его начало
+    void reallocate(const Index n1, const Index n2)
+    {
+        T* p = allocate(n1 * n2);
 
-        if(dm2 == 0) return;
+        try {
+            matrix_detail::uninitialized_move_if_noexcept(buf, buf + sz, p);
+        }
+        catch (...) {
+            matrix_detail::deallocate(p);
+            throw;
+        }
 
-        for (Index i = 0; i < dm1; ++i)
-            data[i] = new T[dm2]();
+        release();
+        buf = p;
+        space_d1 = n1;
+        space_d2 = n2;
     }
-    explicit Matrix(const Index x, const Index y, const T& val) : Matrix(x, y)
+
+    // ёмкость для добавления: не меньше need, и не меньше удвоенной текущей
+    static Index grown(const Index space, const Index need)
     {
-        for (Index i = 0; i < dm1; i++)
-            for (Index j = 0; j < dm2; j++)
-                data[i][j] = val;
+        return std::max(need, space == 0 ? Index(8) : 2 * space);
     }
 
-    template<class Container>
-    explicit Matrix(const Index x, const Index y, const Container& cont) : Matrix(x, y)
+public:
+    explicit Matrix(Index x = 0, Index y = 0) : dm1(x), dm2(y), sz(dm1 * dm2), space_d1(dm1), space_d2(dm2)
     {
-        if(size(cont) != x*y)
-            throw Matrix_error("size of Container is not equal to size of Matrix");
+        if (dm1 < 0 || dm2 < 0)
+            throw Matrix_error("Invalid argument for Matrix<T>::Matrix(Index, Index)");
 
-        auto first = std::begin(cont);
+        buf = allocate(sz);
 
-        for(Index i = 0; i < dm1; ++i)
-        {
-            for(Index j = 0; j < dm2; ++j)
-            {
-                data[i][j] = *first;
-                ++first;
-            }
+        try {
+            matrix_detail::construct_default(buf, buf + sz);
+        }
+        catch (...) {
+            matrix_detail::deallocate(buf);
+            throw;
+        }
+    }
+    explicit Matrix(const Index x, const Index y, const T& val) : dm1(x), dm2(y), sz(dm1 * dm2), space_d1(dm1), space_d2(dm2)
+    {
+        if (dm1 < 0 || dm2 < 0)
+            throw Matrix_error("Invalid argument for Matrix<T>::Matrix(Index, Index, const T&)");
+
+        buf = allocate(sz);
+
+        try {
+            std::uninitialized_fill(buf, buf + sz, val);
+        }
+        catch (...) {
+            matrix_detail::deallocate(buf);
+            throw;
         }
     }
 
-    Matrix(const Matrix& other) : dm1(other.dm1), dm2(other.dm2), sz(other.sz)
+    template<class Container>
+    explicit Matrix(const Index x, const Index y, const Container& cont) : Matrix(x, y)
     {
-        //cout << "Выделение памяти при помощи new в конструкторе копирования" << endl;
+        if(matrix_detail::length(cont) != x*y)
+            throw Matrix_error("size of Container is not equal to size of Matrix");
 
-        data = new T*[dm1];
+        std::copy(std::begin(cont), std::end(cont), buf);
+    }
 
-        for (Index i = 0; i < dm1; ++i)
-            data[i] = new T[dm2]();
+    // ёмкость сохраняется: копия накопленной таблицы может расти дальше без перевыделений
+    Matrix(const Matrix& other) : dm1(other.dm1), dm2(other.dm2), space_d1(other.space_d1), space_d2(other.space_d2)
+    {
+        buf = allocate(space_d1 * space_d2);
 
-        for (Index i = 0; i < dm1; ++i)
-            for (Index j = 0; j < dm2; ++j)
-                data[i][j] = other.data[i][j];
+        try {
+            std::uninitialized_copy(other.buf, other.buf + other.sz, buf);
+        }
+        catch (...) {
+            matrix_detail::deallocate(buf);
+            throw;
+        }
 
-        return;
+        sz = other.sz;
     }
 
     Matrix& operator=(const Matrix& other)
@@ -225,81 +346,33 @@ public:
         if(this == &other)
             return *this;
 
-        if(other.dm1 == 0)
+        // блок переиспользуется, если в него помещаются обе размерности other
+        if(space_d1 < other.dm1 || space_d2 < other.dm2)
         {
-            this->dm2 = other.dm2;
+            Matrix tmp(other);
+            swap(tmp);
             return *this;
         }
 
-        if(dm1 != 0)
-        {
-            if(space_d1 >= other.dm1)
-            {
-                space_d1 -= other.dm1;
-
-                if(dm2 != 0)
-                {
-                    if(space_d2 >= other.dm2){
-                        space_d2 -= other.dm2;
-                    }
-                    else{
-                        for(Index i = 0; i < dm1; ++i)
-                            delete[] data[i];
-
-                        for(Index i = 0; i < other.dm1; ++i)
-                            data[i] = new T[other.dm2];
-
-                        space_d2 = other.dm2;
-                    }
-                }
-                else{
-                    for(Index i = 0; i < other.dm1; ++i)
-                        data[i] = new T[other.dm2];
-                }
-
-                for(Index i = 0; i < other.dm1; ++i)
-                    for(Index j = 0; j < other.dm2; ++j)
-                        data[i][j] = other.data[i][j];
-
-                dm1 = other.dm1;
-                dm2 = other.dm2;
-                sz = other.sz;
-                return *this;
-            }
-            else{
+        const Index common = std::min(sz, other.sz);
 
-                if(dm2 != 0){
-                    for(Index i = 0; i < dm1; ++i)
-                        delete[] data[i];
-                }
-
-                delete[] data;
-            }
-        }
+        std::copy(other.buf, other.buf + common, buf);
 
-        //cout << "Выделение памяти при помощи new в операторе присваивания" << endl;
+        if (other.sz > sz)
+            std::uninitialized_copy(other.buf + sz, other.buf + other.sz, buf + sz);
+        else
+            matrix_detail::destroy(buf + other.sz, buf + sz);
 
         dm1 = other.dm1;
         dm2 = other.dm2;
         sz = other.sz;
-        space_d1 = dm1;
-        space_d2 = dm2;
-
-        data = new T*[dm1];
-
-        for (Index i = 0; i < dm1; ++i)
-            data[i] = new T[dm2]();
-
-        for (Index i = 0; i < dm1; ++i)
-            for (Index j = 0; j < dm2; ++j)
-                data[i][j] = other.data[i][j];
 
         return *this;
     }
 
-    Matrix(Matrix&& other)
+    void swap(Matrix& other) noexcept
     {
-        std::swap(data, other.data);
+        std::swap(buf, other.buf);
         std::swap(dm1, other.dm1);
         std::swap(dm2, other.dm2);
         std::swap(sz, other.sz);
@@ -307,28 +380,26 @@ public:
         std::swap(space_d2, other.space_d2);
     }
 
-    Matrix& operator =(Matrix&& other)
+    Matrix(Matrix&& other) noexcept
+    {
+        swap(other);
+    }
+
+    Matrix& operator =(Matrix&& other) noexcept
     {
         if(this == &other)
             return *this;
 
-        if(dm1 != 0)
-        {
-            if(dm2 != 0)
-                for(Index i = 0; i < dm1; ++i)
-                    delete[] data[i];
+        release();
 
-            delete[] data;
-        }
-
-        data = other.data;
+        buf = other.buf;
         dm1 = other.dm1;
         dm2 = other.dm2;
         sz = other.sz;
         space_d1 = other.space_d1;
         space_d2 = other.space_d2;
 
-        other.data = nullptr;
+        other.buf = nullptr;
         other.dm1 = 0;
         other.dm2 = 0;
         other.sz = 0;
@@ -341,68 +412,41 @@ public:
     inline Index size_dim1() const noexcept { return dm1; }
     inline Index size_dim2() const noexcept { return dm2; }
     inline Index size() const noexcept { return sz; }
+    inline Index stride() const noexcept { return dm2; }
+
+    // непрерывный блок size() элементов по строкам
+    inline T* data() noexcept { return buf; }
+    inline T const* data() const noexcept { return buf; }
+    inline T const* cdata() const noexcept { return buf; }
 
     inline T const& operator ()(const Index i, const Index j) const
     {
         range_check(i, j);
-        return data[i][j];
+        return buf[i * dm2 + j];
     }
     inline T& operator ()(Index i, Index j)
     {
         range_check(i, j);
-        return data[i][j];
+        return buf[i * dm2 + j];
     }
 
-    inline T const* operator [](Index i) const noexcept { return data[i]; }
-    inline T* operator [](Index i) noexcept { return data[i]; }
-
-    // rows [n:dm1)
-    Matrix slice(Index n)
-    {
-        Clamp(n, static_cast<Index>(0), dm1 - 1);
-
-        const Index newsz = dm1 - n;
-        Matrix M(newsz, dm2);
-
-        for (Index i = 0, k = n; i < newsz; ++i, ++k)
-            for (Index j = 0; j < dm2; ++j)
-                M[i][j] = this->data[k][j];
+    inline T const* operator [](Index i) const noexcept { return buf + i * dm2; }
+    inline T* operator [](Index i) noexcept { return buf + i * dm2; }
 
-        return M;
-    }
     // rows [n:dm1)
-    const Matrix slice(Index n) const
+    Matrix slice(Index n) const
     {
         Clamp(n, static_cast<Index>(0), dm1 - 1);
 
         const Index newsz = dm1 - n;
         Matrix M(newsz, dm2);
 
-        for (Index i = 0, k = n; i < newsz; ++i, ++k)
-            for (Index j = 0; j < dm2; ++j)
-                M[i][j] = this->data[k][j];
-
-        return M;
-    }
-    //	rows [n:m)
-    Matrix slice(Index n, Index m)
-    {
-        Clamp(n, static_cast<Index>(0), dm1 - 1);
-        Clamp(m, static_cast<Index>(0), dm1 - 1);
-
-        if (m <= n) throw Matrix_error("wrong slice");
-
-        const Index newsz = m - n + 1;
-        Matrix M(newsz, dm2);
-
-        for (Index i = 0, k = n; i < newsz; ++i, ++k)
-            for (Index j = 0; j < dm2; ++j)
-                M[i][j] = this->data[k][j];
+        std::copy((*this)[n], (*this)[n] + newsz * dm2, M.buf);
 
         return M;
     }
     //	rows [n:m)
-    const Matrix slice(Index n, Index m) const
+    Matrix slice(Index n, Index m) const
     {
         Clamp(n, static_cast<Index>(0), dm1 - 1);
         Clamp(m, static_cast<Index>(0), dm1 - 1);
@@ -412,34 +456,12 @@ public:
         const Index newsz = m - n + 1;
         Matrix M(newsz, dm2);
 
-        for (Index i = 0, k = n; i < newsz; ++i, ++k)
-            for (Index j = 0; j < dm2; ++j)
-                M[i][j] = this->data[k][j];
-
-        return M;
-    }
-    // rows and colls [n1:m1) and [n2:m2)
-    Matrix slice(Index n1, Index n2, Index m1, Index m2)
-    {
-        Clamp(n1, static_cast<Index>(0), dm1 - 1);
-        Clamp(m1, static_cast<Index>(0), dm1 - 1);
-        Clamp(n2, static_cast<Index>(0), dm2 - 1);
-        Clamp(m2, static_cast<Index>(0), dm2 - 1);
-
-        if (m1 <= n1 || m2 <= n2) throw Matrix_error("wrong slice");
-
-        const Index newsz_1 = m1 - n1 + 1;
-        const Index newsz_2 = m2 - n2 + 1;
-        Matrix M(newsz_1, newsz_2);
-
-        for (Index i = 0, a = n1; i < newsz_1; ++i, ++a)
-            for (Index j = 0, b = n2; j < newsz_2; ++j, ++b)
-                M[i][j] = this->data[a][b];
+        std::copy((*this)[n], (*this)[n] + newsz * dm2, M.buf);
 
         return M;
     }
     // rows and colls [n1:m1) and [n2:m2)
-    const Matrix slice(Index n1, Index n2, Index m1, Index m2) const
+    Matrix slice(Index n1, Index n2, Index m1, Index m2) const
     {
         Clamp(n1, static_cast<Index>(0), dm1 - 1);
         Clamp(m1, static_cast<Index>(0), dm1 - 1);
@@ -453,25 +475,21 @@ public:
         Matrix M(newsz_1, newsz_2);
 
         for (Index i = 0, a = n1; i < newsz_1; ++i, ++a)
-            for (Index j = 0, b = n2; j < newsz_2; ++j, ++b)
-                M[i][j] = this->data[a][b];
+            std::copy((*this)[a] + n2, (*this)[a] + n2 + newsz_2, M[i]);
 
         return M;
     }
 
     void fill(const T& val)
     {
-        for (Index i = 0; i < dm1; ++i)
-            for (Index j = 0; j < dm2; ++j)
-                data[i][j] = val;
+        std::fill(buf, buf + sz, val);
     }
 
     void fill_row(Index i, const T& val)
     {
         range_check(i, 0, dm1 - 1);
 
-        for (Index j = 0; j < dm2; ++j)
-            data[i][j] = val;
+        std::fill((*this)[i], (*this)[i] + dm2, val);
     }
 
     template<class Container>
@@ -479,16 +497,10 @@ public:
     {
         range_check(i, 0, dm1 - 1);
 
-        if(size(cont) != dm2)
+        if(matrix_detail::length(cont) != dm2)
             throw Matrix_error("size of Container is not equal to size of this row");
 
-        auto first = std::begin(cont);
-
-        for(Index j = 0; j < dm2; ++j)
-        {
-            data[i][j] = *first;
-            first++;
-        }
+        std::copy(std::begin(cont), std::end(cont), (*this)[i]);
     }
 
     void fill_col(Index j, const T& val)
@@ -496,7 +508,7 @@ public:
         range_check(j, 0, dm2 - 1);
 
         for (Index i = 0; i < dm1; ++i)
-            data[i][j] = val;
+            buf[i * dm2 + j] = val;
     }
 
     template<class Container>
@@ -504,14 +516,14 @@ public:
     {
         range_check(j, 0, dm2 - 1);
 
-        if(size(cont) != dm1)
+        if(matrix_detail::length(cont) != dm1)
             throw Matrix_error("size of Container is not equal to size of this col");
 
         auto first = std::begin(cont);
 
         for(Index i = 0; i < dm1; ++i)
         {
-            data[i][j] = *first;
+            buf[i * dm2 + j] = *first;
             first++;
         }
     }
@@ -519,9 +531,8 @@ public:
     template<typename F, typename... Args>
     void apply(F func, Args&&... args)
     {
-        for (Index i = 0; i < dm1; i++)
-            for (Index j = 0; j < dm2; j++)
-                data[i][j] = func(data[i][j], std::forward<Args>(args)...);
+        for (Index k = 0; k < sz; ++k)
+            buf[k] = func(buf[k], std::forward<Args>(args)...);
     }
 
     template<typename F, typename... Args>
@@ -529,8 +540,9 @@ public:
     {
         range_check(i, 0, dm1 - 1);
 
+        T* row = (*this)[i];
         for (Index j = 0; j < dm2; ++j)
-            data[i][j] = func(data[i][j], std::forward<Args>(args)...);
+            row[j] = func(row[j], std::forward<Args>(args)...);
     }
 
     template<typename F, typename... Args>
@@ -539,30 +551,25 @@ public:
         range_check(j, 0, dm2 - 1);
 
         for (Index i = 0; i < dm1; ++i)
-            data[i][j] = func(data[i][j], std::forward<Args>(args)...);
+            buf[i * dm2 + j] = func(buf[i * dm2 + j], std::forward<Args>(args)...);
     }
 
+    // reserve_* выделяет ровно сколько просили, resize_* и add_* растят ёмкость геометрически
     void reserve_d1(Index newalloc)
     {
         if (newalloc <= space_d1) return;
 
-        T** p = new T*[newalloc];
-
-        for (Index i = 0; i < dm1; ++i)
-            p[i] = data[i];
-
-        delete[] data;
-        data = p;
-        space_d1 = newalloc;
+        reallocate(newalloc, space_d2);
     }
     Index capacity_d1() const { return space_d1; }
     void resize_d1(Index newsize)
     {
         if (newsize <= dm1) return;
 
-        reserve_d1(newsize);
-        for (Index i = dm1; i < newsize; ++i)
-            data[i] = new T[space_d2]();
+        if (newsize > space_d1)
+            reserve_d1(grown(space_d1, newsize));
+
+        matrix_detail::construct_default(buf + sz, buf + newsize * dm2);
 
         dm1 = newsize;
         sz = dm1 * dm2;
@@ -570,15 +577,7 @@ public:
 
     void add_d1()
     {
-        if (space_d1 == 0)
-            reserve_d1(8);
-        else if (dm1 == space_d1)
-            reserve_d1(2 * space_d1);
-
-        data[dm1] = new T[space_d2]();
-
-        ++dm1;
-        sz = dm1 * dm2;
+        resize_d1(dm1 + 1);
     }
 
     bool add_d1(const T& val)
@@ -586,12 +585,13 @@ public:
         if(dm2 == 0)
             return false;
 
-        Index old_dm1 = dm1;
+        if (dm1 == space_d1)
+            reserve_d1(grown(space_d1, dm1 + 1));
 
-        add_d1();
+        std::uninitialized_fill(buf + sz, buf + sz + dm2, val);
 
-        for (Index i = 0; i < dm2; i++)
-            data[old_dm1][i] = val;
+        ++dm1;
+        sz = dm1 * dm2;
 
         return true;
     }
@@ -599,20 +599,16 @@ public:
     template<class Container>
     bool add_d1(const Container& cont)
     {
-        if(dm2 == 0 || size(cont) != dm2)
+        if(dm2 == 0 || matrix_detail::length(cont) != dm2)
             return false;
 
-        auto first 	= std::begin(cont);
-
-        Index old_dm1 = dm1;
+        if (dm1 == space_d1)
+            reserve_d1(grown(space_d1, dm1 + 1));
 
-        add_d1();
+        std::uninitialized_copy(std::begin(cont), std::end(cont), buf + sz);
 
-        for (Index i = 0; i < dm2; i++)
-        {
-            data[old_dm1][i] = *first;
-            first++;
-        }
+        ++dm1;
+        sz = dm1 * dm2;
 
         return true;
     }
@@ -621,47 +617,22 @@ public:
     {
         if (newalloc <= space_d2) return;
 
-        for (Index i = 0; i < dm1; i++)
-        {
-            T* p = new T[newalloc];
-
-            for (Index j = 0; j < dm2; j++)
-                p[j] = data[i][j];
-
-            delete[] data[i];
-            data[i] = p;
-        }
-
-        space_d2 = newalloc;
+        reallocate(space_d1, newalloc);
     }
     Index capacity_d2() const { return space_d2; }
     void resize_d2(Index newsize)
     {
         if (newsize <= dm2) return;
 
-        reserve_d2(newsize);
-        for (Index i = 0; i < dm1; i++)
-        {
-            for (Index j = dm2; j < newsize; j++)
-                data[i][j] = {};
-        }
+        if (newsize > space_d2)
+            reserve_d2(grown(space_d2, newsize));
 
-        dm2 = newsize;
-        sz = dm1 * dm2;
+        widen(newsize);
     }
 
     void add_d2()
     {
-        if (space_d2 == 0)
-            reserve_d2(8);
-        else if (dm2 == space_d2)
-            reserve_d2(2 * space_d2);
-
-        for (Index i = 0; i < dm1; i++)
-            data[i][dm2] = {};
-
-        ++dm2;
-        sz = dm1 * dm2;
+        resize_d2(dm2 + 1);
     }
 
     bool add_d2(const T& val)
@@ -669,12 +640,8 @@ public:
         if(dm1 == 0)
             return false;
 
-        Index old_dm2 = dm2;
-
         add_d2();
-
-        for (Index i = 0; i < dm1; i++)
-            data[i][old_dm2] = val;
+        fill_col(dm2 - 1, val);
 
         return true;
     }
@@ -682,22 +649,30 @@ public:
     template<class Container>
     bool add_d2(const Container& cont)
     {
-        if(dm1 == 0 || size(cont) != dm1)
+        if(dm1 == 0 || matrix_detail::length(cont) != dm1)
             return false;
 
-        auto first = std::begin(cont);
+        add_d2();
+        fill_col(dm2 - 1, cont);
 
-        Index old_dm2 = dm2;
+        return true;
+    }
 
-        add_d2();
+    // блок ровно под текущие размеры; пустая матрица освобождает его совсем
+    void shrink_to_fit()
+    {
+        if (space_d1 == dm1 && space_d2 == dm2) return;
 
-        for (Index i = 0; i < dm1; ++i)
+        if (sz == 0)
         {
-            data[i][old_dm2] = *first;
-            first++;
+            release();
+            buf = nullptr;
+            space_d1 = dm1;
+            space_d2 = dm2;
+            return;
         }
 
-        return true;
+        reallocate(dm1, dm2);
     }
 
     void del_d1() { del_d1(dm1 - 1); }
@@ -706,13 +681,10 @@ public:
         if (num < 0 || num >= dm1)
             throw Matrix_error("Index is outside of Matrix");
 
-        delete data[num];
+        std::move((*this)[num + 1], buf + sz, (*this)[num]);
+        matrix_detail::destroy(buf + sz - dm2, buf + sz);
 
         --dm1;
-
-        for (Index i = num; i < dm1; ++i)
-            std::swap(data[i], data[i + 1]);
-
         sz = dm1 * dm2;
     }
 
@@ -722,12 +694,16 @@ public:
         if (num < 0 || num >= dm2)
             throw Matrix_error("Index is outside of Matrix");
 
-        --dm2;
+        // строки остаются плотными: элементы сдвигаются к началу блока, пропуская столбец num;
+        // до первого удаляемого элемента (num) всё уже на месте
+        Index w = num;
+        for (Index k = num + 1; k < sz; ++k)
+            if (k % dm2 != num)
+                buf[w++] = std::move(buf[k]);
 
-        for (Index i = 0; i < dm1; ++i)
-            for (Index j = num; j < dm2; ++j)
-                std::swap(data[i][j], data[i][j + 1]);
+        matrix_detail::destroy(buf + w, buf + sz);
 
+        --dm2;
         sz = dm1 * dm2;
     }
 
@@ -756,454 +732,54 @@ public:
         return os;
     }
 
-    class MatrixIterator : public std::iterator<std::input_iterator_tag, T>
-    {
-        friend class Matrix;
-    private:
-        MatrixIterator(T** p, Index s) noexcept : p(p), step(s - 1), left(0) {}
-    public:
-        MatrixIterator(const MatrixIterator &it) noexcept : p(it.p), step(it.step), left(it.left) {}
-        MatrixIterator& operator =(const MatrixIterator&) = default;
-
-        bool operator!=(MatrixIterator const& other) const noexcept { return p != other.p || left != other.left || step != other.step; }
-        bool operator==(MatrixIterator const& other) const noexcept { return p == other.p && left == other.left && step == other.step; }
-        T& operator*() const noexcept { return *(*p + left); }
-        MatrixIterator& operator++() noexcept
-        {
-            if (left >= step)
-            {
-                left = 0;
-                ++p;
-                return *this;
-            }
-            left++;
-            return *this;
-        }
-        MatrixIterator& operator++(int) noexcept
-        {
-            auto _tmp = *this;
-            this->operator++();
-            return _tmp;
-        }
-    private:
-        T * * p;
-        Index step;
-        Index left;
-    };
-
-    class ConstMatrixIterator : public std::iterator<std::input_iterator_tag, T>
-    {
-        friend class Matrix;
-    private:
-        ConstMatrixIterator(T** p, Index s) noexcept : p(const_cast<const T**>(p)), step(s - 1), left(0) {}
-    public:
-        ConstMatrixIterator(const ConstMatrixIterator &it) noexcept : p(it.p), step(it.step), left(it.left) {}
-        ConstMatrixIterator& operator =(const ConstMatrixIterator&) = default;
-
-        inline bool operator!=(ConstMatrixIterator const& other) const noexcept { return p != other.p || left != other.left || step != other.step; }
-        inline bool operator==(ConstMatrixIterator const& other) const noexcept { return p == other.p && left == other.left && step == other.step; }
-        inline T const& operator*() const noexcept { return *(*p + left); }
-        inline ConstMatrixIterator& operator++() noexcept
-        {
-            if (left >= step)
-            {
-                left = 0;
-                ++p;
-                return *this;
-            }
-            left++;
-            return *this;
-        }
-        inline ConstMatrixIterator& operator++(int) noexcept
-        {
-            auto _tmp = *this;
-            this->operator++();
-            return _tmp;
-        }
-    private:
-        const T** p;
-        Index step;
-        Index left;
-    };
-
-    using iterator = MatrixIterator;
-    using const_iterator = ConstMatrixIterator;
+    using iterator = T*;
+    using const_iterator = const T*;
 
-    inline iterator begin() noexcept { return iterator(data, dm2); }
-    inline iterator end() noexcept { return iterator(data + dm1, dm2); }
+    inline iterator begin() noexcept { return buf; }
+    inline iterator end() noexcept { return buf + sz; }
 
     inline const_iterator begin() const noexcept { return this->cbegin(); }
     inline const_iterator end() const noexcept { return this->cend(); }
 
-    inline const_iterator cbegin() const noexcept { return const_iterator(data, dm2); }
-    inline const_iterator cend() const noexcept { return const_iterator(data + dm1, dm2); }
+    inline const_iterator cbegin() const noexcept { return buf; }
+    inline const_iterator cend() const noexcept { return buf + sz; }
 
     ~Matrix()
     {
-        //cout << "Удаление" << endl;
+        release();
+    }
 
-        if (dm1 == 0)
-            return;
+private:
+    // строки раздвигаются под новую ширину на месте, с последней строки; новые столбцы - T().
+    // Слоты ниже старого size() живые и получают присваивание, выше - конструируются.
+    // Ёмкости должно хватать: space_d2 >= newsize
+    void widen(const Index newsize)
+    {
+        T* const live = buf + sz;
+
+        auto put = [live](T* slot, T&& val) {
+            if (slot < live)
+                *slot = std::move(val);
+            else
+                ::new (static_cast<void*>(slot)) T(std::move(val));
+        };
 
-        if(dm2 != 0)
-            for (Index i = 0; i < dm1; i++)
-                    delete[] data[i];
+        for (Index i = dm1 - 1; i >= 0; --i)
+        {
+            T* src = buf + i * dm2;
+            T* dst = buf + i * newsize;
+
+            for (Index j = newsize - 1; j >= dm2; --j)
+                put(dst + j, T());
+
+            if (dst != src)
+                for (Index j = dm2 - 1; j >= 0; --j)
+                    put(dst + j, std::move(src[j]));
+        }
 
-        delete[] data;
+        dm2 = newsize;
+        sz = dm1 * dm2;
     }
 };
 
-//  Матрица на куче
-//template<typename T>
-//class Matrix
-//{
-//private:
-//    T** data;
-//    Index dm1;
-//    Index dm2;
-//    Index sz;
-//    Index space_d1;    // общий размер для dm1
-//    Index space_d2;    // общий размер для dm2
-
-//public:
-//    Matrix() noexcept : data(nullptr), dm1(0), dm2(0), sz(0), space_d1(0), space_d2(0) {}
-//    Matrix(const Index x, const Index y) : dm1(x), dm2(y), sz(dm1 * dm2), space_d1(dm1), space_d2(dm2)
-//    {
-//        if (dm1 <= 0 || dm2 <= 0) {
-//           throw invalid_argument("Invalid argument for Matrix<T>::Matrix(const Index, const Index)");
-//           return;
-//        }
-
-//        data = new T*[dm1];
-
-//        for(Index i = 0; i < dm1; i++)
-//            data[i] = new T[dm2]();
-
-//    }
-//    Matrix(const Index x, const Index y, const T& val) : Matrix(x, y)
-//    {
-//        for(Index i = 0; i < dm1; i++)
-//        {
-//            for(Index j = 0; j < dm2; j++)
-//            {
-//                data[i][j] = val;
-//            }
-//        }
-//    }
-
-//    Matrix(const Matrix& other) : dm1(other.dm1), dm2(other.dm2), sz(other.sz), space_d1(other.space_d1), space_d2(other.space_d2)
-//    {
-//        copy(other.begin(), other.end(), this->begin());
-//    }
-
-//    Matrix(Matrix&& other) : Matrix()
-//    {
-//        swap(data, other.data);
-//        swap(dm1, other.dm1);
-//        swap(dm2, other.dm2);
-//        swap(sz, other.sz);
-//        swap(space_d1, other.space_d1);
-//        swap(space_d2, other.space_d2);
-//    }
-
-//    Matrix& operator=(const Matrix&) = default;
-//    Matrix& operator =(Matrix&&) = default;
-
-//    Index size_dim1() const noexcept { return dm1; }
-//    Index size_dim2() const noexcept { return dm2; }
-//    Index size() const noexcept { return sz; }
-
-//    //  индексация с проверкой диапазона
-//    const T& operator ()(Index i,  Index j) const
-//    {
-//        if(i < 0 || i >= dm1 || j < 0 || j >= dm2)
-//            throw out_of_range("Index is outside of Matrix");
-
-//        return data[i][j];
-//    }
-//    T& operator ()(Index i, Index j)
-//    {
-//        if(i < 0 || i >= dm1 || j < 0 || j >= dm2)
-//            throw out_of_range("Index is outside of Matrix");
-
-//        return data[i][j];
-//    }
-
-//    const T* operator [](Index i) const { return data[i]; }
-//    T* operator [](Index i) { return data[i]; }
-
-//    void fill(T&& val)
-//    {
-//        for(Index i = 0; i < dm1; i++)
-//            for(Index j = 0; j < dm2; j++)
-//                data[i][j] = move(val);
-//    }
-
-//    // применяет переданную функцию/функциональный объект к каждому M[i][j]
-//    template<typename F, typename... Args>
-//    void apply(F func, Args&&... args)
-//    {
-//        for(Index i = 0; i < dm1; i++)
-//            for(Index j = 0; j < dm2; j++)
-//                data[i][j] = func(data[i][j], std::forward<Args>(args)...);
-//    }
-
-
-//    void reserve_d1(Index newalloc)
-//    {
-//        if(newalloc <= space_d1) return;
-
-//        T** p = new T*[newalloc];
-
-//        for(Index i = 0; i < dm1; ++i)
-//            p[i] = data[i];
-
-//        delete[] data;
-//        data = p;
-//        space_d1 = newalloc;
-//    }
-//    Index capacity_d1() const { return space_d1; }
-//    void resize_d1(Index newsize)
-//    {
-//        if(newsize <= dm1) return;
-
-//        reserve_d1(newsize);
-//        for(Index i = dm1; i < newsize; ++i)
-//            data[i] = new T[space_d2]();
-
-//        dm1 = newsize;
-//        sz = dm1 * dm2;
-//    }
-//    void add_d1(const T& val)
-//    {
-//        if(space_d1 == 0)
-//            reserve_d1(8);
-//        else if(dm1 == space_d1)
-//            reserve_d1(2 * space_d1);
-
-//        data[dm1] = new T[space_d2];
-
-//        for(Index i = 0; i < dm2; i++)
-//            data[dm1][i] = val;
-
-//        ++dm1;
-//        sz = dm1 * dm2;
-//    }
-//    template<typename Iter>
-//    void add_d1(Iter first, Iter last)
-//    {
-//        if(std::distance(first, last) != dm2)
-//            return;
-
-//        if(space_d1 == 0)
-//            reserve_d1(8);
-//        else if(dm1 == space_d1)
-//            reserve_d1(2 * space_d1);
-
-//        data[dm1] = new T[space_d2];
-
-//        for(Index i = 0; i < dm2; i++)
-//        {
-//            data[dm1][i] = *first;
-//            first++;
-//        }
-
-//        ++dm1;
-//        sz = dm1 * dm2;
-//    }
-
-
-//    void reserve_d2(Index newalloc)
-//    {
-//        if(newalloc <= space_d2) return;
-
-//        for(Index i = 0; i < dm1; i++)
-//        {
-//            T* p = new T[newalloc];
-
-//            for(Index j = 0; j < dm2; j++)
-//                p[j] = data[i][j];
-
-//            delete[] data[i];
-//            data[i] = p;
-//        }
-
-//        space_d2 = newalloc;
-//    }
-//    Index capacity_d2() const { return space_d2; }
-//    void resize_d2(Index newsize)
-//    {
-//        if(newsize <= dm2) return;
-
-//        reserve_d2(newsize);
-//        for(Index i = 0; i < dm1; i++)
-//        {
-//            for(Index j = dm2; j < newsize; j++)
-//                data[i][j] = {};
-//        }
-
-//        dm2 = newsize;
-//        sz = dm1 * dm2;
-//    }
-//    void add_d2(const T& val)
-//    {
-//        if(space_d2 == 0)
-//            reserve_d2(8);
-//        else if(dm2 == space_d2)
-//            reserve_d2(2 * space_d2);
-
-//        for(Index i = 0; i < dm1; i++)
-//            data[i][dm2] = val;
-
-//        ++dm2;
-//        sz = dm1 * dm2;
-//    }
-//    template<typename Iter>
-//    void add_d2(Iter first, Iter last)
-//    {
-//        if(std::distance(first, last) != dm1)
-//            return;
-
-//        if(space_d2 == 0)
-//            reserve_d2(8);
-//        else if(dm2 == space_d2)
-//            reserve_d2(2 * space_d2);
-
-//        for(Index i = 0; i < dm1; i++)
-//        {
-//            data[i][dm2] = *first;
-//            first++;
-//        }
-
-//        ++dm2;
-//        sz = dm1 * dm2;
-//    }
-
-
-//    friend ostream& operator <<(ostream& os, const Matrix& m)
-//    {
-//        os << "{" << endl;
-//        for(Index i = 0; i < m.dm1; i++)
-//        {
-//            os << "{ ";
-//            for(Index j = 0; j < m.dm2; j++)
-//            {
-//                os << m[i][j];
-
-//                if(j != m.dm2 - 1)
-//                    os << ", ";
-//            }
-//            os << " }";
-
-//            if(i != m.dm1 - 1)
-//                os << ", ";
-
-//            os << endl;
-//        }
-//        os << "}";
-
-//        return os;
-//    }
-
-//    class MatrixIterator : public std::iterator<std::input_iterator_tag, T>
-//    {
-//        friend class Matrix;
-//    private:
-//        MatrixIterator(T** p, Index s) : p(p), step(s), left(0) {}
-//    public:
-//        MatrixIterator(const MatrixIterator &it) : p(it.p), step(it.step), left(it.left) {}
-//        MatrixIterator& operator =(const MatrixIterator&) = default;
-
-//        bool operator!=(MatrixIterator const& other) const { return p != other.p || left != other.left || step != other.step; }
-//        bool operator==(MatrixIterator const& other) const { return p == other.p && left == other.left && step == other.step; }
-//        T& operator*() const { return *(*p + left); }
-//        MatrixIterator& operator++()
-//        {
-//            if(left >= step)
-//            {
-//                left = 0;
-//                ++p;
-//                return *this;
-//            }
-//            left++;
-//            return *this;
-//        }
-//        MatrixIterator& operator++(int)
-//        {
-//            if(left >= step)
-//            {
-//                left = 0;
-//                ++p;
-//                return *this;
-//            }
-//            left++;
-//            return *this;
-//        }
-//    private:
-//        T** p;
-//        Index step;
-//        Index left;
-//    };
-
-//    class ConstMatrixIterator : public std::iterator<std::input_iterator_tag, T>
-//    {
-//        friend class Matrix;
-//    private:
-//        ConstMatrixIterator(T** p, Index s) : p(const_cast<const T**>(p)), step(s), left(0) {}
-//    public:
-//        ConstMatrixIterator(const ConstMatrixIterator &it) : p(it.p), step(it.step), left(it.left) {}
-//        ConstMatrixIterator& operator =(const ConstMatrixIterator&) = default;
-
-//        bool operator!=(ConstMatrixIterator const& other) const { return p != other.p || left != other.left || step != other.step; }
-//        bool operator==(ConstMatrixIterator const& other) const { return p == other.p && left == other.left && step == other.step; }
-//        T const& operator*() const { return *(*p + left); }
-//        ConstMatrixIterator& operator++()
-//        {
-//            if(left >= step)
-//            {
-//                left = 0;
-//                ++p;
-//                return *this;
-//            }
-//            left++;
-//            return *this;
-//        }
-//        ConstMatrixIterator& operator++(int)
-//        {
-//           if(left >= step)
-//           {
-//                left = 0;
-//                ++p;
-//                return *this;
-//            }
-//            left++;
-//            return *this;
-//        }
-//    private:
-//        const T** p;
-//        Index step;
-//        Index left;
-//    };
-
-//    using iterator = MatrixIterator;
-//    using const_iterator = ConstMatrixIterator;
-
-//    iterator begin() { return iterator(data, dm2 - 1); }
-//    iterator end() { return iterator(data + dm1, dm2 - 1); }
-
-//    const_iterator cbegin() { return const_iterator(data, dm2 - 1); }
-//    const_iterator cend() { return const_iterator(data + dm1, dm2 - 1); }
-
-//    ~Matrix()
-//    {
-//        if(data == nullptr)
-//            return;
-
-//        for(Index i = 0; i < dm1; i++)
-//            delete[] data[i];
-
-//        delete[] data;
-//    }
-//};
-
 #endif // MATRIX_H
@@ -11,7 +11,6 @@
 #include <iostream>
 #include <iomanip>
 #include <fstream>
-#include "mycoloriterator.h"
 #include "matrix.h"
 #include "mainwindow.h"
 
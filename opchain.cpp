@@ -0,0 +1,266 @@
+#include "opchain.h"
+
+#include <QStringList>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// параметры шага: args[0] - имя, дальше значения; отсутствующие берутся по умолчанию
+bool IntArg(const QStringList& args, const int pos, const int def, int* out)
+{
+    if (args.size() <= pos)
+    {
+        *out = def;
+        return true;
+    }
+
+    bool ok = false;
+    *out = args[pos].toInt(&ok);
+    return ok;
+}
+
+bool DoubleArg(const QStringList& args, const int pos, const double def, double* out)
+{
+    if (args.size() <= pos)
+    {
+        *out = def;
+        return true;
+    }
+
+    bool ok = false;
+    *out = args[pos].toDouble(&ok);
+    return ok;
+}
+
+bool OddKsz(const int ksz)
+{
+    return ksz >= 3 && ksz % 2 == 1;
+}
+
+bool ParseStep(const QString& text, OpStep* step, QString* error)
+{
+    const QStringList args = text.split(':');
+    const QString name = args[0].trimmed().toLower();
+    const bool no_args = name == "gray-world" || name == "linear" || name.startsWith("rotate-") || name.startsWith("mirror-");
+    const int max_args = no_args ? 1 : (name == "gamma" || name == "border") ? 3 : 2;
+
+    step->name = text;
+
+    if (args.size() > max_args)
+    {
+        *error = QString("лишние параметры у \"%1\"").arg(text);
+        return false;
+    }
+
+    auto bad = [&](){
+        *error = QString("неверные параметры у \"%1\"").arg(text);
+        return false;
+    };
+
+    if (name == "gray-world")
+        step->run = [](ImageProc& p, QImage* img){ p.GrayWorld(img); };
+    else if (name == "linear")
+        step->run = [](ImageProc& p, QImage* img){ p.LinearCorr(img); };
+    else if (name == "gamma")
+    {
+        double c, d;
+        if (!DoubleArg(args, 1, 1.0, &c) || !DoubleArg(args, 2, 1.0, &d) || c <= 0.0 || d <= 0.0)
+            return bad();
+
+        step->run = [c, d](ImageProc& p, QImage* img){ p.GammaFunc(img, c, d); };
+    }
+    else if (name == "gauss")
+    {
+        double sigma;
+        if (!DoubleArg(args, 1, 0.84, &sigma) || !(sigma > 0.0))
+            return bad();
+
+        step->run = [sigma](ImageProc& p, QImage* img){ p.GaussBlur(img, sigma); };
+        step->run_planar = [sigma](ImageProc& p, PlanarImage* img){ p.GaussBlur(img, sigma); };
+    }
+    else if (name == "box")
+    {
+        int ksz;
+        if (!IntArg(args, 1, 3, &ksz) || !OddKsz(ksz))
+            return bad();
+
+        step->run = [ksz](ImageProc& p, QImage* img){ p.BoxFilter(img, ksz, ksz); };
+    }
+    else if (name == "median" || name == "erosion" || name == "dilate")
+    {
+        int ksz;
+        if (!IntArg(args, 1, 3, &ksz) || !OddKsz(ksz))
+            return bad();
+
+        if (name == "median")
+        {
+            step->run = [ksz](ImageProc& p, QImage* img){ p.MedianFilter(img, ksz); };
+            step->run_planar = [ksz](ImageProc& p, PlanarImage* img){ p.MedianFilter(img, ksz); };
+        }
+        else if (name == "erosion")
+        {
+            step->run = [ksz](ImageProc& p, QImage* img){ p.Erosion(img, ksz); };
+            step->run_planar = [ksz](ImageProc& p, PlanarImage* img){ p.Erosion(img, ksz); };
+        }
+        else
+        {
+            step->run = [ksz](ImageProc& p, QImage* img){ p.Increase(img, ksz); };
+            step->run_planar = [ksz](ImageProc& p, PlanarImage* img){ p.Increase(img, ksz); };
+        }
+    }
+    else if (name == "custom")
+    {
+        // коэффициенты через пробел, по строкам ядра: "custom:1 2 1 2 4 2 1 2 1"
+        if (args.size() < 2)
+            return bad();
+
+        vector<double> kernel;
+        for (const QString& v : args[1].split(' ', QString::SkipEmptyParts))
+        {
+            bool ok = false;
+            kernel.push_back(v.toDouble(&ok));
+            if (!ok)
+                return bad();
+        }
+
+        const int ksz = static_cast<int>(std::lround(std::sqrt(kernel.size())));
+        if (!OddKsz(ksz) || static_cast<size_t>(ksz * ksz) != kernel.size())
+            return bad();
+
+        step->run = [kernel](ImageProc& p, QImage* img){
+            vector<double> k = kernel;
+            p.CustomFilter(img, &k);
+        };
+    }
+    else if (name == "border")
+    {
+        // режим края для следующих шагов: "border:constant:ff8000" - цвет в hex
+        static const vector<pair<QString, BorderMode>> modes = {
+            { "reflect", BorderMode::Reflect },
+            { "reflect101", BorderMode::Reflect101 },
+            { "replicate", BorderMode::Replicate },
+            { "constant", BorderMode::Constant },
+            { "wrap", BorderMode::Wrap },
+        };
+
+        if (args.size() < 2)
+            return bad();
+
+        auto it = find_if(modes.begin(), modes.end(), [&](const pair<QString, BorderMode>& m){
+            return m.first == args[1].trimmed().toLower();
+        });
+
+        if (it == modes.end() || (args.size() > 2 && it->second != BorderMode::Constant))
+            return bad();
+
+        QRgb color = qRgb(0, 0, 0);
+        if (args.size() > 2)
+        {
+            QString hex = args[2].trimmed();
+            if (hex.startsWith('#'))
+                hex = hex.mid(1);
+
+            bool ok = false;
+            const uint v = hex.toUInt(&ok, 16);
+            if (!ok || hex.size() != 6)
+                return bad();
+
+            color = qRgb(qRed(v), qGreen(v), qBlue(v));
+        }
+
+        const BorderMode mode = it->second;
+        step->run = [mode, color](ImageProc& p, QImage*){ p.SetBorder(mode, color); };
+    }
+    else if (name == "rotate-left")
+        step->run = [](ImageProc& p, QImage* img){ p.rotate_left(img); };
+    else if (name == "rotate-right")
+        step->run = [](ImageProc& p, QImage* img){ p.rotate_right(img); };
+    else if (name == "rotate-180")
+        step->run = [](ImageProc& p, QImage* img){ p.rotate_180(img); };
+    else if (name == "mirror-h")
+        step->run = [](ImageProc&, QImage* img){ *img = img->mirrored(false, true); };
+    else if (name == "mirror-v")
+        step->run = [](ImageProc&, QImage* img){ *img = img->mirrored(true, false); };
+    else
+    {
+        *error = QString("неизвестная операция \"%1\"").arg(name);
+        return false;
+    }
+
+    return true;
+}
+
+}
+
+bool ParseOpChain(const QString& text, OpChain* chain, QString* error)
+{
+    OpChain result;
+
+    for (const QString& part : text.split(',', QString::SkipEmptyParts))
+    {
+        OpStep step;
+        if (!ParseStep(part.trimmed(), &step, error))
+            return false;
+
+        result.push_back(move(step));
+    }
+
+    if (result.empty())
+    {
+        *error = "пустая цепочка операций";
+        return false;
+    }
+
+    *chain = move(result);
+    return true;
+}
+
+QString OpChainHelp()
+{
+    return "Операции:\n"
+           "  gray-world              серый мир\n"
+           "  linear                  линейное растяжение\n"
+           "  gamma[:c[:d]]           c * x^d (по умолчанию 1:1)\n"
+           "  gauss[:sigma]           размытие по Гауссу (по умолчанию 0.84)\n"
+           "  box[:k]                 среднее по окну k x k (по умолчанию 3)\n"
+           "  median[:k]              медианный фильтр k x k (по умолчанию 3)\n"
+           "  erosion[:k]             эрозия k x k\n"
+           "  dilate[:k]              наращивание k x k\n"
+           "  custom:<k*k чисел>      свёртка с ядром, числа через пробел\n"
+           "  border:<режим>[:rrggbb] край для следующих фильтров: reflect (по умолчанию),\n"
+           "                          reflect101, replicate, wrap, constant (цвет, по умолчанию чёрный)\n"
+           "  rotate-left, rotate-right, rotate-180\n"
+           "  mirror-h, mirror-v\n";
+}
+
+void RunOpChain(const OpChain& chain, ImageProc& proc, QImage* img)
+{
+    // режим края, заданный цепочкой для предыдущего изображения, не должен действовать на шаги до border
+    proc.SetBorder(BorderMode::Reflect);
+
+    PlanarImage planar;
+
+    for (size_t i = 0; i < chain.size(); )
+    {
+        size_t run_end = i;
+        while (run_end < chain.size() && chain[run_end].run_planar)
+            ++run_end;
+
+        // одиночный шаг быстрее выполнить над QImage, чем распаковывать ради него
+        if (run_end - i < 2 || img->isNull())
+        {
+            chain[i].run(proc, img);
+            ++i;
+            continue;
+        }
+
+        planar.assign(ViewOf(*img));
+
+        for (; i < run_end; ++i)
+            chain[i].run_planar(proc, &planar);
+
+        planar.store(MutableViewOf(*img));
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef OPCHAIN_H
+#define OPCHAIN_H
+
+#include <QImage>
+#include <QString>
+
+#include <functional>
+#include <vector>
+
+#include "imageproc.h"
+
+//  Цепочка операций ImageProc, заданная строкой вида "gray-world,median:5,gauss:1.5".
+//  Шаги разделяются запятыми, параметры шага - двоеточиями.
+
+struct OpStep
+{
+    QString name;
+    std::function<void(ImageProc&, QImage*)> run;
+    std::function<void(ImageProc&, PlanarImage*)> run_planar;  // пусто, если у шага нет варианта для плоскостей
+};
+
+using OpChain = std::vector<OpStep>;
+
+// false и описание ошибки в *error, если строка не разобрана; *chain тогда не меняется
+bool ParseOpChain(const QString& text, OpChain* chain, QString* error);
+
+// список операций и их параметров для справки
+QString OpChainHelp();
+
+// Подряд идущие шаги с вариантом для плоскостей (не меньше двух) выполняются над PlanarImage:
+// распаковка перед первым из них и упаковка после последнего
+void RunOpChain(const OpChain& chain, ImageProc& proc, QImage* img);
+
+#endif // OPCHAIN_H
@@ -0,0 +1,207 @@
+#include "opgraph.h"
+
+#include <cmath>
+#include <utility>
+
+// нечётный размер окна ksz для изображения, уменьшенного в 1 / scale раз; 1 - окно вырождается
+int ScaledKsz(const int ksz, const double scale)
+{
+    return 2 * static_cast<int>(std::lround(ksz / 2 * scale)) + 1;
+}
+
+void OpGraph::AddTone(const bool needs_stats, std::function<ToneLut(const ImageStats&)> tone)
+{
+    Node node;
+    node.kind = Kind::Tone;
+    node.needs_stats = needs_stats;
+    node.tone = move(tone);
+    nodes.push_back(move(node));
+}
+
+void OpGraph::AddOp(const Kind kind, std::function<void(ImageProc&, QImage*, double)> run)
+{
+    Node node;
+    node.kind = kind;
+    node.run = move(run);
+    nodes.push_back(move(node));
+}
+
+void OpGraph::GrayWorld()
+{
+    AddTone(true, GrayWorldTone);
+}
+
+void OpGraph::LinearCorr()
+{
+    AddTone(true, LinearCorrTone);
+}
+
+void OpGraph::Gamma(const double c, const double d)
+{
+    AddTone(false, [c, d](const ImageStats&){ return ToneLut::Gamma(c, d); });
+}
+
+void OpGraph::GaussBlur(const double sigma)
+{
+    AddOp(Kind::Filter, [sigma](ImageProc& p, QImage* img, double scale){ p.GaussBlur(img, sigma * scale); });
+}
+
+void OpGraph::MedianFilter(const int ksz)
+{
+    AddOp(Kind::Filter, [ksz](ImageProc& p, QImage* img, double scale){ p.MedianFilter(img, ScaledKsz(ksz, scale)); });
+}
+
+void OpGraph::CustomFilter(const vector<double>& kernel)
+{
+    // коэффициенты заданы в пикселях, на уменьшенной копии ядро то же
+    AddOp(Kind::Filter, [kernel](ImageProc& p, QImage* img, double){
+        vector<double> k = kernel;
+        p.CustomFilter(img, &k);
+    });
+}
+
+void OpGraph::Erosion(const int ksz)
+{
+    AddOp(Kind::Filter, [ksz](ImageProc& p, QImage* img, double scale){
+        const int k = ScaledKsz(ksz, scale);
+        if (k > 1)
+            p.Erosion(img, k);
+    });
+}
+
+void OpGraph::Increase(const int ksz)
+{
+    AddOp(Kind::Filter, [ksz](ImageProc& p, QImage* img, double scale){
+        const int k = ScaledKsz(ksz, scale);
+        if (k > 1)
+            p.Increase(img, k);
+    });
+}
+
+void OpGraph::RotateLeft()
+{
+    AddOp(Kind::Geometry, [](ImageProc& p, QImage* img, double){ p.rotate_left(img); });
+}
+
+void OpGraph::RotateRight()
+{
+    AddOp(Kind::Geometry, [](ImageProc& p, QImage* img, double){ p.rotate_right(img); });
+}
+
+void OpGraph::Rotate180()
+{
+    AddOp(Kind::Geometry, [](ImageProc& p, QImage* img, double){ p.rotate_180(img); });
+}
+
+void OpGraph::MirrorH()
+{
+    AddOp(Kind::Geometry, [](ImageProc&, QImage* img, double){ *img = img->mirrored(false, true); });
+}
+
+void OpGraph::MirrorV()
+{
+    AddOp(Kind::Geometry, [](ImageProc&, QImage* img, double){ *img = img->mirrored(true, false); });
+}
+
+bool OpGraph::isToneOnly() const
+{
+    for (const Node& node : nodes)
+        if (node.kind != Kind::Tone)
+            return false;
+
+    return true;
+}
+
+bool OpGraph::needsStats() const
+{
+    for (const Node& node : nodes)
+        if (node.kind == Kind::Tone && node.needs_stats)
+            return true;
+
+    return false;
+}
+
+ToneLut OpGraph::NodeTone(const Node& node, ImageProc& proc, const QImage* img, const ToneLut& lut)
+{
+    // гистограмма источника кэшируется в ImageProc, пересчёт через lut - 3 x 256 операций
+    if (node.needs_stats)
+        return node.tone(RemapStats(proc.Stats(img), lut));
+
+    return node.tone(ImageStats());
+}
+
+ToneLut OpGraph::Tone(ImageProc& proc, const QImage* img) const
+{
+    ToneLut lut;
+
+    if (img->isNull())
+        return lut;
+
+    for (const Node& node : nodes)
+        if (node.kind == Kind::Tone)
+            lut = lut.then(NodeTone(node, proc, img, lut));
+
+    return lut;
+}
+
+void OpGraph::Execute(ImageProc& proc, QImage* img, const double scale, OpProgress* progress)
+{
+    if (img->isNull())
+    {
+        clear();
+        return;
+    }
+
+    // поточечные операции, ещё не применённые к *img
+    ToneLut lut;
+
+    // этапы для хода выполнения: узлы и итоговое применение таблицы
+    const int stages = static_cast<int>(nodes.size()) + 1;
+
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        const Node& node = nodes[i];
+
+        if (progress)
+            progress->Stage(static_cast<int>(i), stages);
+
+        switch (node.kind)
+        {
+        case Kind::Tone:
+            lut = lut.then(NodeTone(node, proc, img, lut));
+            break;
+
+        case Kind::Geometry:
+            node.run(proc, img, scale);
+            break;
+
+        case Kind::Filter:
+            if (lut.isIdentity())
+            {
+                node.run(proc, img, scale);
+                break;
+            }
+
+            {
+                const qint64 key = img->cacheKey();
+
+                proc.SetInputTone(&lut);
+                node.run(proc, img, scale);
+                proc.SetInputTone(nullptr);
+
+                // фильтр ничего не сделал (размер ядра больше изображения и т.п.) - таблица отдельно
+                if (img->cacheKey() == key)
+                    proc.ApplyTone(img, lut);
+            }
+
+            lut = ToneLut();
+            break;
+        }
+    }
+
+    if (progress)
+        progress->Stage(stages - 1, stages);
+
+    proc.ApplyTone(img, lut);
+    clear();
+}
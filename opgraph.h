@@ -0,0 +1,89 @@
+#ifndef OPGRAPH_H
+#define OPGRAPH_H
+
+#include <QImage>
+#include <QSize>
+
+#include <functional>
+#include <vector>
+
+#include "imageproc.h"
+#include "tonelut.h"
+
+//  Отложенные операции над изображением: записываются по одной, выполняются вместе (Execute).
+//  Подряд идущие поточечные операции (GrayWorld, LinearCorr, Gamma) сворачиваются в одну таблицу
+//  ToneLut, их параметры, зависящие от статистики, считаются по пересчитанной гистограмме
+//  (RemapStats) без прохода по пикселям. Свёрнутая таблица применяется к пикселям при загрузке
+//  тайлов следующего фильтра окрестности, а если его нет - одним проходом в конце.
+//  Повороты и отражения с поточечными операциями перестановочны, таблицу они не сбрасывают.
+//  Результат совпадает с последовательным выполнением тех же операций.
+class OpGraph
+{
+public:
+    void GrayWorld();
+    void LinearCorr();
+    void Gamma(double c, double d);
+    void GaussBlur(double sigma);
+    void MedianFilter(int ksz);
+    void CustomFilter(const vector<double>& kernel);
+    void Erosion(int ksz);
+    void Increase(int ksz);
+    void RotateLeft();
+    void RotateRight();
+    void Rotate180();
+    void MirrorH();
+    void MirrorV();
+
+    bool isEmpty() const { return nodes.empty(); }
+    void clear() { nodes.clear(); }
+
+    // только поточечные операции - результат можно показать, применив Tone к уменьшенной копии
+    bool isToneOnly() const;
+
+    // свёрнутая таблица поточечных операций для изображения img (для isToneOnly)
+    ToneLut Tone(ImageProc& proc, const QImage* img) const;
+
+    // Tone нужна статистика img (GrayWorld, LinearCorr): проход по пикселям, если её нет в кэше proc
+    bool needsStats() const;
+
+    // Выполняет все операции над *img и очищает граф. scale < 1 - *img уменьшенная копия
+    // (предпросмотр): размеры окон фильтров и sigma уменьшаются в том же отношении.
+    // progress - ход задания ImageProc::RenderGo, в него отмечаются этапы (узлы графа); в отменённом
+    // задании Execute прерывается исключением OperationCancelled, *img тогда выполнен частично и не нужен.
+    void Execute(ImageProc& proc, QImage* img, double scale = 1.0, OpProgress* progress = nullptr);
+
+private:
+    enum class Kind { Tone, Filter, Geometry };
+
+    struct Node
+    {
+        Kind kind;
+        bool needs_stats = false;                               // Tone: таблица зависит от статистики входа
+        std::function<ToneLut(const ImageStats&)> tone;         // Tone
+        std::function<void(ImageProc&, QImage*, double)> run;   // Filter, Geometry; масштаб для Execute
+    };
+
+    std::vector<Node> nodes;
+
+    void AddTone(bool needs_stats, std::function<ToneLut(const ImageStats&)> tone);
+    void AddOp(Kind kind, std::function<void(ImageProc&, QImage*, double)> run);
+
+    // таблица узла node для изображения img после преобразования lut
+    static ToneLut NodeTone(const Node& node, ImageProc& proc, const QImage* img, const ToneLut& lut);
+};
+
+//  Задание для ImageProc::RenderGo (или StatsGo): граф над копией изображения. Задания с номером generation
+//  меньше последнего (ImageProc::SetGeneration) устарели: ещё не начатые пропускаются.
+struct RenderJob
+{
+    quint64 generation = 0;
+    OpGraph graph;
+    QImage image;           // источник, после выполнения - результат
+    QSize proxy;            // не пустой - сначала уменьшить image до этого размера (с сохранением пропорций)
+    double scale = 1.0;     // отношение размера результата к размеру источника
+    OpProgress progress;    // отмена и ход выполнения, настраивается в RenderGo
+    ToneLut tone;           // результат StatsGo: graph.Tone для image
+    ImageStats stats;       // результат StatsGo: статистика image после tone
+};
+
+#endif // OPGRAPH_H
@@ -0,0 +1,88 @@
+#include "planar.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "threadpool.h"
+
+// строк на кусок пула при распаковке и упаковке
+constexpr int PlanarBandRows = 32;
+
+void PlanarImage::resize(const int width, const int height)
+{
+    w = width;
+    h = height;
+    stride = (width + 63) / 64 * 64;
+
+    for (auto& p : planes)
+        if (p.size_dim1() != height || p.size_dim2() != stride)
+            p = Matrix<uchar>(height, stride);
+}
+
+void PlanarImage::assign(const ConstImageView& src)
+{
+    resize(src.width(), src.height());
+
+    ThreadPool::Instance().ParallelFor(0, h, PlanarBandRows, [&](int begin_y, int end_y){
+        for (int j = begin_y; j < end_y; ++j)
+        {
+            const QRgb* in = src.line(j);
+            uchar* r = planes[R][j];
+            uchar* g = planes[G][j];
+            uchar* b = planes[B][j];
+
+            for (int i = 0; i < w; ++i)
+            {
+                r[i] = static_cast<uchar>(qRed(in[i]));
+                g[i] = static_cast<uchar>(qGreen(in[i]));
+                b[i] = static_cast<uchar>(qBlue(in[i]));
+            }
+        }
+    });
+}
+
+void PlanarImage::store(const ImageView& dst) const
+{
+    ThreadPool::Instance().ParallelFor(0, h, PlanarBandRows, [&](int begin_y, int end_y){
+        for (int j = begin_y; j < end_y; ++j)
+        {
+            QRgb* out = dst.line(j);
+            const uchar* r = planes[R][j];
+            const uchar* g = planes[G][j];
+            const uchar* b = planes[B][j];
+
+            for (int i = 0; i < w; ++i)
+                out[i] = qRgb(r[i], g[i], b[i]);
+        }
+    });
+}
+
+PlaneView PlanarImage::plane(const int c) noexcept
+{
+    return PlaneView(planes[c].data(), w, h, stride, QImage::Format_Grayscale8);
+}
+
+ConstPlaneView PlanarImage::plane(const int c) const noexcept
+{
+    return ConstPlaneView(planes[c].data(), w, h, stride, QImage::Format_Grayscale8);
+}
+
+void PlanarImage::swap(PlanarImage& other) noexcept
+{
+    for (int c = 0; c < Planes; ++c)
+        planes[c].swap(other.planes[c]);
+
+    std::swap(w, other.w);
+    std::swap(h, other.h);
+    std::swap(stride, other.stride);
+}
+
+uchar PlanarImage::channel(const QRgb color, const int c) noexcept
+{
+    switch (c)
+    {
+    case R: return static_cast<uchar>(qRed(color));
+    case G: return static_cast<uchar>(qGreen(color));
+    default: return static_cast<uchar>(qBlue(color));
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef PLANAR_H
+#define PLANAR_H
+
+#include <QImage>
+#include <QRgb>
+
+#include <array>
+
+#include "imageview.h"
+#include "matrix.h"
+
+//  Изображение по плоскостям: R, G, B - каждая отдельным массивом байт. Альфа не хранится:
+//  как и фильтры над QImage, упаковка даёт RGB32 с альфой 255. Цепочка из нескольких фильтров распаковывает QImage один раз (assign),
+//  фильтры читают подряд идущие байты одного канала без распаковки QRgb на каждом шаге,
+//  а обратно пиксели упаковываются тоже один раз (store).
+//  Строки плоскости выровнены на 64 байта, как и начало блока Matrix.
+class PlanarImage
+{
+public:
+    static constexpr int R = 0;
+    static constexpr int G = 1;
+    static constexpr int B = 2;
+    static constexpr int Planes = 3;
+
+    // размеры; содержимое не сохраняется
+    void resize(int width, int height);
+
+    // распаковка R, G, B; альфа источника отбрасывается
+    void assign(const ConstImageView& src);
+
+    // упаковка в dst того же размера, альфа = 255
+    void store(const ImageView& dst) const;
+
+    int width() const noexcept { return w; }
+    int height() const noexcept { return h; }
+    bool isNull() const noexcept { return w <= 0 || h <= 0; }
+
+    PlaneView plane(int c) noexcept;
+    ConstPlaneView plane(int c) const noexcept;
+
+    void swap(PlanarImage& other) noexcept;
+
+    // значение канала c цвета color (для Constant за краем)
+    static uchar channel(QRgb color, int c) noexcept;
+
+private:
+    std::array<Matrix<uchar>, Planes> planes;   // height x stride
+    int w = 0;
+    int h = 0;
+    int stride = 0;
+};
+
+#endif // PLANAR_H
@@ -0,0 +1,244 @@
+#include "pointops.h"
+
+#include <atomic>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define POINTOPS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC/Clang требуют явно разрешить набор инструкций для функции, MSVC - нет
+#if defined(__GNUC__) || defined(__clang__)
+#define POINTOPS_TARGET(x) __attribute__((target(x)))
+#else
+#define POINTOPS_TARGET(x)
+#endif
+
+namespace {
+
+std::atomic<int> simd_cap{ static_cast<int>(SimdLevel::AVX2) };
+
+inline uchar clamp_trunc(const float v) noexcept
+{
+    // NaN и отрицательные -> 0, как при насыщающей упаковке в SIMD-ветках
+    if (v > 0.0f)
+        return v < 255.0f ? static_cast<uchar>(static_cast<int>(v)) : 255;
+
+    return 0;
+}
+
+void AffineScalar(QRgb* p, std::size_t count, const std::array<float, 3>& s, const std::array<float, 3>& o)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const QRgb c = p[i];
+        p[i] = qRgb(clamp_trunc(qRed(c) * s[0] + o[0]),
+                    clamp_trunc(qGreen(c) * s[1] + o[1]),
+                    clamp_trunc(qBlue(c) * s[2] + o[2]));
+    }
+}
+
+void TableScalar(QRgb* p, std::size_t count, const std::array<ChannelTable, 3>& t)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const QRgb c = p[i];
+        p[i] = qRgb(t[0][qRed(c)], t[1][qGreen(c)], t[2][qBlue(c)]);
+    }
+}
+
+#if defined(POINTOPS_X86)
+
+// лямбды не наследуют target-атрибут, поэтому вспомогательные функции отдельно.
+// Значения >= 2^31 и +inf cvttps превратил бы в INT_MIN (после упаковки 0), поэтому сначала
+// min с 255 - как clamp_trunc. Операнды именно в таком порядке: при NaN min возвращает второй,
+// и NaN по-прежнему даёт 0.
+POINTOPS_TARGET("sse2")
+inline __m128i AffinePixelSSE2(const __m128i x, const __m128 sc, const __m128 of)
+{
+    const __m128 v = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(x), sc), of);
+    return _mm_cvttps_epi32(_mm_min_ps(_mm_set1_ps(255.0f), v));
+}
+
+POINTOPS_TARGET("avx2")
+inline __m256i AffinePixelsAVX2(const __m128i x, const __m256 sc, const __m256 of)
+{
+    const __m256 v = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(x)), sc), of);
+    return _mm256_cvttps_epi32(_mm256_min_ps(_mm256_set1_ps(255.0f), v));
+}
+
+// 4 пикселя за итерацию: байты -> int32 -> float, по одному пикселю на регистр
+POINTOPS_TARGET("sse2")
+void AffineSSE2(QRgb* p, std::size_t count, const std::array<float, 3>& s, const std::array<float, 3>& o)
+{
+    // в памяти пиксель лежит как B, G, R, A
+    const __m128 sc = _mm_setr_ps(s[2], s[1], s[0], 0.0f);
+    const __m128 of = _mm_setr_ps(o[2], o[1], o[0], 255.0f);
+    const __m128i zero = _mm_setzero_si128();
+
+    std::size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i* ptr = reinterpret_cast<__m128i*>(p + i);
+        const __m128i v = _mm_loadu_si128(ptr);
+
+        const __m128i lo = _mm_unpacklo_epi8(v, zero);
+        const __m128i hi = _mm_unpackhi_epi8(v, zero);
+
+        const __m128i q0 = AffinePixelSSE2(_mm_unpacklo_epi16(lo, zero), sc, of);
+        const __m128i q1 = AffinePixelSSE2(_mm_unpackhi_epi16(lo, zero), sc, of);
+        const __m128i q2 = AffinePixelSSE2(_mm_unpacklo_epi16(hi, zero), sc, of);
+        const __m128i q3 = AffinePixelSSE2(_mm_unpackhi_epi16(hi, zero), sc, of);
+
+        _mm_storeu_si128(ptr, _mm_packus_epi16(_mm_packs_epi32(q0, q1), _mm_packs_epi32(q2, q3)));
+    }
+
+    AffineScalar(p + i, count - i, s, o);
+}
+
+// 8 пикселей за итерацию, по два пикселя на регистр
+POINTOPS_TARGET("avx2")
+void AffineAVX2(QRgb* p, std::size_t count, const std::array<float, 3>& s, const std::array<float, 3>& o)
+{
+    const __m256 sc = _mm256_setr_ps(s[2], s[1], s[0], 0.0f, s[2], s[1], s[0], 0.0f);
+    const __m256 of = _mm256_setr_ps(o[2], o[1], o[0], 255.0f, o[2], o[1], o[0], 255.0f);
+    // после упаковки пиксели идут как 0, 2, 4, 6, 1, 3, 5, 7
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m128i* src = reinterpret_cast<const __m128i*>(p + i);
+        const __m128i v0 = _mm_loadu_si128(src);
+        const __m128i v1 = _mm_loadu_si128(src + 1);
+
+        const __m256i q0 = AffinePixelsAVX2(v0, sc, of);
+        const __m256i q1 = AffinePixelsAVX2(_mm_srli_si128(v0, 8), sc, of);
+        const __m256i q2 = AffinePixelsAVX2(v1, sc, of);
+        const __m256i q3 = AffinePixelsAVX2(_mm_srli_si128(v1, 8), sc, of);
+
+        const __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(q0, q1), _mm256_packs_epi32(q2, q3));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(p + i), _mm256_permutevar8x32_epi32(packed, order));
+    }
+
+    AffineScalar(p + i, count - i, s, o);
+}
+
+// 8 пикселей за итерацию: три выборки (gather) из 32-битных таблиц, уже сдвинутых на место канала
+POINTOPS_TARGET("avx2")
+void TableAVX2(QRgb* p, std::size_t count, const std::array<ChannelTable, 3>& t)
+{
+    alignas(32) int tr[256];
+    alignas(32) int tg[256];
+    alignas(32) int tb[256];
+
+    for (int v = 0; v < 256; ++v)
+    {
+        tr[v] = t[0][v] << 16;
+        tg[v] = t[1][v] << 8;
+        tb[v] = t[2][v];
+    }
+
+    const __m256i mask = _mm256_set1_epi32(0xFF);
+    const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xFF000000u));
+
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i* ptr = reinterpret_cast<__m256i*>(p + i);
+        const __m256i v = _mm256_loadu_si256(ptr);
+
+        const __m256i r = _mm256_i32gather_epi32(tr, _mm256_and_si256(_mm256_srli_epi32(v, 16), mask), 4);
+        const __m256i g = _mm256_i32gather_epi32(tg, _mm256_and_si256(_mm256_srli_epi32(v, 8), mask), 4);
+        const __m256i b = _mm256_i32gather_epi32(tb, _mm256_and_si256(v, mask), 4);
+
+        _mm256_storeu_si256(ptr, _mm256_or_si256(_mm256_or_si256(r, g), _mm256_or_si256(b, alpha)));
+    }
+
+    TableScalar(p + i, count - i, t);
+}
+
+#endif // POINTOPS_X86
+
+} // namespace
+
+SimdLevel DetectSimdLevel()
+{
+#if defined(POINTOPS_X86)
+#  if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int nids = info[0];
+
+    __cpuid(info, 1);
+    const bool sse2 = (info[3] & (1 << 26)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+
+    bool avx2 = false;
+    if (nids >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6)
+    {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+#  else
+    __builtin_cpu_init();
+    const bool sse2 = __builtin_cpu_supports("sse2");
+    const bool avx2 = __builtin_cpu_supports("avx2");
+#  endif
+
+    if (avx2)
+        return SimdLevel::AVX2;
+    if (sse2)
+        return SimdLevel::SSE2;
+#endif
+    return SimdLevel::Scalar;
+}
+
+SimdLevel ActiveSimdLevel()
+{
+    static const SimdLevel detected = DetectSimdLevel();
+    const int cap = simd_cap.load(std::memory_order_relaxed);
+
+    return static_cast<int>(detected) < cap ? detected : static_cast<SimdLevel>(cap);
+}
+
+void SetSimdLevel(SimdLevel level)
+{
+    simd_cap.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+void ApplyAffine(QRgb* pixels, std::size_t count,
+                 const std::array<float, 3>& scale, const std::array<float, 3>& offset)
+{
+    switch (ActiveSimdLevel())
+    {
+#if defined(POINTOPS_X86)
+    case SimdLevel::AVX2:
+        AffineAVX2(pixels, count, scale, offset);
+        return;
+    case SimdLevel::SSE2:
+        AffineSSE2(pixels, count, scale, offset);
+        return;
+#endif
+    default:
+        AffineScalar(pixels, count, scale, offset);
+    }
+}
+
+void ApplyTable(QRgb* pixels, std::size_t count, const std::array<ChannelTable, 3>& tables)
+{
+#if defined(POINTOPS_X86)
+    // у SSE2 нет выборки по индексам, скалярный цикл по таблице для неё не медленнее
+    if (ActiveSimdLevel() == SimdLevel::AVX2)
+    {
+        TableAVX2(pixels, count, tables);
+        return;
+    }
+#endif
+    TableScalar(pixels, count, tables);
+}
@@ -0,0 +1,27 @@
+#ifndef POINTOPS_H
+#define POINTOPS_H
+
+#include <QRgb>
+
+#include <array>
+#include <cstddef>
+
+//  Поточечные операции над буфером пикселей ARGB32.
+//  Реализация выбирается при первом вызове по возможностям процессора: AVX2, SSE2 или скалярная.
+
+enum class SimdLevel { Scalar, SSE2, AVX2 };
+
+SimdLevel DetectSimdLevel();
+SimdLevel ActiveSimdLevel();
+void SetSimdLevel(SimdLevel level);     // ограничить сверху (для сравнения реализаций)
+
+using ChannelTable = std::array<uchar, 256>;
+
+// out = clamp(trunc(in * scale + offset)) поканально, scale и offset в порядке R, G, B; альфа = 255
+void ApplyAffine(QRgb* pixels, std::size_t count,
+                 const std::array<float, 3>& scale, const std::array<float, 3>& offset);
+
+// out = table[канал][in], таблицы в порядке R, G, B; альфа = 255
+void ApplyTable(QRgb* pixels, std::size_t count, const std::array<ChannelTable, 3>& tables);
+
+#endif // POINTOPS_H
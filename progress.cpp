@@ -0,0 +1,73 @@
+#include "progress.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "threadpool.h"
+
+constexpr std::chrono::milliseconds OpProgress::ReportInterval;
+
+void OpProgress::Begin(const double mpix, std::function<bool()> cancelled, Report report)
+{
+    this->mpix = mpix;
+    this->cancelled = std::move(cancelled);
+    this->report = std::move(report);
+
+    stage = 0;
+    stages = 1;
+    shown = 0.0;
+    start = last_report = Clock::now();
+}
+
+void OpProgress::Stage(const int stage, const int stages)
+{
+    this->stage = stage;
+    this->stages = std::max(stages, 1);
+}
+
+void OpProgress::ParallelFor(const int first, const int last, const int grain,
+                             const std::function<void(int, int)>& func)
+{
+    const double total = last - first;
+    std::atomic<int> done{0};
+
+    ThreadPool::Instance().ParallelFor(first, last, grain, [&](int begin, int end){
+        if (cancelled && cancelled())
+            throw OperationCancelled();
+
+        func(begin, end);
+
+        Done((done += end - begin) / total);
+    });
+}
+
+// кусок прохода выполнен: pass_fraction - доля выполненного прохода (ParallelFor)
+void OpProgress::Done(const double pass_fraction)
+{
+    if (!report)
+        return;
+
+    const Clock::time_point now = Clock::now();
+
+    std::lock_guard<std::mutex> lock(m);
+
+    if (now - last_report < ReportInterval)
+        return;
+
+    last_report = now;
+
+    // у операции из нескольких проходов доля этапа начинается заново с каждым проходом
+    shown = std::max(shown, (stage + pass_fraction) / stages);
+
+    const double seconds = std::chrono::duration<double>(now - start).count();
+    report(shown, seconds > 0.0 ? shown * mpix / seconds : 0.0);
+}
+
+void ParallelFor(OpProgress* job, const int first, const int last, const int grain,
+                 const std::function<void(int, int)>& func)
+{
+    if (job)
+        job->ParallelFor(first, last, grain, func);
+    else
+        ThreadPool::Instance().ParallelFor(first, last, grain, func);
+}
@@ -0,0 +1,55 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+
+//  Отмена и ход выполнения задания ImageProc::RenderGo. У каждого задания (RenderJob) свой
+//  OpProgress; операции делят работу на куски через ParallelFor ниже: перед каждым куском
+//  проверяется отмена - тогда операция прерывается исключением OperationCancelled и результат
+//  не записывается, - а после куска пересчитывается доля выполненного, и не чаще раза
+//  в ReportInterval вызывается report.
+
+struct OperationCancelled {};
+
+class OpProgress
+{
+public:
+    // fraction - доля выполненного задания, mpix_per_s - скорость в мегапикселях изображения в секунду
+    using Report = std::function<void(double fraction, double mpix_per_s)>;
+
+    // задание над изображением в mpix мегапикселей; cancelled вызывается перед каждым куском
+    void Begin(double mpix, std::function<bool()> cancelled, Report report);
+
+    // этап stage из stages (операция графа): доля внутри этапа снова считается с нуля
+    void Stage(int stage, int stages);
+
+    // func(begin, end) для кусков [first, last) длиной grain, как ThreadPool::ParallelFor
+    void ParallelFor(int first, int last, int grain, const std::function<void(int, int)>& func);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr std::chrono::milliseconds ReportInterval{100};
+
+    double mpix = 0.0;
+    std::function<bool()> cancelled;
+    Report report;
+
+    int stage = 0;
+    int stages = 1;
+
+    std::mutex m;
+    double shown = 0.0;             // уже сообщённая доля: не уменьшается внутри задания
+    Clock::time_point start;
+    Clock::time_point last_report;
+
+    void Done(double pass_fraction);
+};
+
+// Вне задания (job == nullptr) - ThreadPool::ParallelFor, отмены нет и OperationCancelled не бросается
+void ParallelFor(OpProgress* job, int first, int last, int grain, const std::function<void(int, int)>& func);
+
+#endif // PROGRESS_H
@@ -0,0 +1,136 @@
+#include "svd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <utility>
+
+// предел числа проходов по всем парам столбцов; обычно хватает 6 - 10
+constexpr int JacobiMaxSweeps = 60;
+
+void JacobiSvd(Matrix<double>& a, Matrix<double>& v, std::vector<double>& s)
+{
+    const Index m = a.size_dim1();
+    const Index n = a.size_dim2();
+
+    v = Matrix<double>(n, n, 0.0);
+    for (Index i = 0; i < n; ++i)
+        v[i][i] = 1.0;
+
+    // вращения пар столбцов p, q, пока все пары не станут ортогональны с точностью double
+    for (int sweep = 0; sweep < JacobiMaxSweeps; ++sweep)
+    {
+        bool rotated = false;
+
+        for (Index p = 0; p < n - 1; ++p)
+        {
+            for (Index q = p + 1; q < n; ++q)
+            {
+                double alpha = 0.0;
+                double beta = 0.0;
+                double gamma = 0.0;
+
+                for (Index i = 0; i < m; ++i)
+                {
+                    alpha += a[i][p] * a[i][p];
+                    beta += a[i][q] * a[i][q];
+                    gamma += a[i][p] * a[i][q];
+                }
+
+                if (gamma == 0.0 || std::fabs(gamma) <= 1e-15 * std::sqrt(alpha * beta))
+                    continue;
+
+                rotated = true;
+
+                const double zeta = (beta - alpha) / (2.0 * gamma);
+                const double t = (zeta >= 0.0 ? 1.0 : -1.0) / (std::fabs(zeta) + std::sqrt(1.0 + zeta * zeta));
+                const double c = 1.0 / std::sqrt(1.0 + t * t);
+                const double sn = c * t;
+
+                for (Index i = 0; i < m; ++i)
+                {
+                    const double ap = a[i][p];
+                    const double aq = a[i][q];
+                    a[i][p] = c * ap - sn * aq;
+                    a[i][q] = sn * ap + c * aq;
+                }
+
+                for (Index i = 0; i < n; ++i)
+                {
+                    const double vp = v[i][p];
+                    const double vq = v[i][q];
+                    v[i][p] = c * vp - sn * vq;
+                    v[i][q] = sn * vp + c * vq;
+                }
+            }
+        }
+
+        if (!rotated)
+            break;
+    }
+
+    s.assign(n, 0.0);
+    for (Index j = 0; j < n; ++j)
+    {
+        for (Index i = 0; i < m; ++i)
+            s[j] += a[i][j] * a[i][j];
+
+        s[j] = std::sqrt(s[j]);
+    }
+}
+
+bool DecomposeKernel(const std::vector<double>& kernel, const int ksz, const int max_rank, const double tol,
+                     std::vector<SeparableTerm>* terms)
+{
+    // строка x - горизонтальное смещение: ядро = a v^T = сумма столбцов a, умноженных на столбцы v
+    Matrix<double> a(ksz, ksz);
+    for (int x = 0; x < ksz; ++x)
+        for (int y = 0; y < ksz; ++y)
+            a[x][y] = kernel[x * ksz + y];
+
+    Matrix<double> v;
+    std::vector<double> s;
+    JacobiSvd(a, v, s);
+
+    std::vector<int> order(ksz);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&s](int i, int j){ return s[i] > s[j]; });
+
+    // остаток после первых rank слагаемых - точно, по самому ядру, а не по сингулярным числам
+    std::vector<double> rest = kernel;
+    std::vector<SeparableTerm> result;
+
+    for (int rank = 0; rank <= max_rank; ++rank)
+    {
+        double err = 0.0;
+        for (double w : rest)
+            err += std::fabs(w);
+
+        if (err <= tol)
+        {
+            terms->swap(result);
+            return true;
+        }
+
+        if (rank == ksz)
+            break;
+
+        const int j = order[rank];
+        SeparableTerm term;
+        term.h.resize(ksz);
+        term.v.resize(ksz);
+
+        for (int x = 0; x < ksz; ++x)
+            term.h[x] = a[x][j];
+        for (int y = 0; y < ksz; ++y)
+            term.v[y] = v[y][j];
+
+        for (int x = 0; x < ksz; ++x)
+            for (int y = 0; y < ksz; ++y)
+                rest[x * ksz + y] -= term.h[x] * term.v[y];
+
+        result.push_back(std::move(term));
+    }
+
+    return false;
+}
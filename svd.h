@@ -0,0 +1,28 @@
+#ifndef SVD_H
+#define SVD_H
+
+#include <vector>
+
+#include "matrix.h"
+
+//  Сингулярное разложение небольших матриц (ядер свёртки) односторонним методом Якоби
+//  и разложение ядра CustomFilter в сумму сепарабельных слагаемых по нему.
+
+// Одно слагаемое: вес пикселя со смещением (x - ksz/2, y - ksz/2) равен h[x] * v[y]
+struct SeparableTerm
+{
+    std::vector<double> h;
+    std::vector<double> v;
+};
+
+// a (m x n) = U diag(s) V^T. На выходе столбцы a - U diag(s) (попарно ортогональны),
+// v (n x n) - V, s - нормы столбцов a. Порядок произвольный.
+void JacobiSvd(Matrix<double>& a, Matrix<double>& v, std::vector<double>& s);
+
+// Ядро ksz x ksz (kernel[x * ksz + y], как у CustomFilter) в виде суммы наименьшего числа
+// сепарабельных слагаемых, сумма модулей отклонения весов которой от ядра не больше tol.
+// false, если слагаемых для этого нужно больше max_rank.
+bool DecomposeKernel(const std::vector<double>& kernel, int ksz, int max_rank, double tol,
+                     std::vector<SeparableTerm>* terms);
+
+#endif // SVD_H
@@ -0,0 +1,189 @@
+#include "threadpool.h"
+
+#include <algorithm>
+
+namespace {
+
+// индекс очереди текущего потока пула, -1 для посторонних потоков
+thread_local int worker_index = -1;
+
+}
+
+ThreadPool& ThreadPool::Instance()
+{
+    static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
+
+ThreadPool::ThreadPool(unsigned n)
+{
+    const unsigned workers = n - 1;
+
+    for (unsigned i = 0; i < std::max(workers, 1u); ++i)
+        queues.emplace_back(new Queue());
+
+    active = workers;
+
+    for (unsigned i = 0; i < workers; ++i)
+        threads.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+void ThreadPool::SetMaxThreads(unsigned n)
+{
+    const unsigned workers = static_cast<unsigned>(threads.size());
+
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        active = (n == 0) ? workers : std::min(n - 1, workers);
+    }
+    wake.notify_all();
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stop = true;
+    }
+    wake.notify_all();
+
+    for (auto& t : threads)
+        t.join();
+}
+
+void ThreadPool::Run(const Task& task)
+{
+    Job* job = task.job;
+
+    try {
+        (*job->func)(task.begin, task.end);
+    }
+    catch (...) {
+        std::lock_guard<std::mutex> lock(job->m);
+        if (!job->error)
+            job->error = std::current_exception();
+    }
+
+    // под мьютексом: ожидающий не выйдет из ParallelFor (и не уничтожит job), пока мы его держим
+    std::lock_guard<std::mutex> lock(job->m);
+    if (--job->remaining == 0)
+        job->done.notify_all();
+}
+
+bool ThreadPool::TryRunOne(int self)
+{
+    // потоки пула сверх SetMaxThreads простаивают; перебираются все очереди,
+    // чтобы не потерять задачи, розданные до смены ограничения
+    if (self >= static_cast<int>(active.load()))
+        return false;
+
+    const int n = static_cast<int>(queues.size());
+
+    // своя очередь - с конца (последние добавленные задачи ещё в кэше)
+    if (self >= 0)
+    {
+        Queue& q = *queues[self];
+        std::unique_lock<std::mutex> lock(q.m);
+
+        if (!q.tasks.empty())
+        {
+            const Task task = q.tasks.back();
+            q.tasks.pop_back();
+            lock.unlock();
+
+            --pending;
+            Run(task);
+            return true;
+        }
+    }
+
+    // чужие - с начала
+    const int start = self >= 0 ? self + 1 : 0;
+    for (int k = 0; k < n; ++k)
+    {
+        const int victim = (start + k) % n;
+        if (victim == self)
+            continue;
+
+        Queue& q = *queues[victim];
+        std::unique_lock<std::mutex> lock(q.m);
+
+        if (!q.tasks.empty())
+        {
+            const Task task = q.tasks.front();
+            q.tasks.pop_front();
+            lock.unlock();
+
+            --pending;
+            Run(task);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::WorkerLoop(unsigned self)
+{
+    worker_index = static_cast<int>(self);
+
+    for (;;)
+    {
+        if (TryRunOne(worker_index))
+            continue;
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        wake.wait(lock, [this, self]{ return stop || (pending.load() > 0 && self < active.load()); });
+
+        if (stop)
+            return;
+    }
+}
+
+void ThreadPool::ParallelFor(int first, int last, int grain, const std::function<void(int, int)>& func)
+{
+    if (last <= first)
+        return;
+
+    grain = std::max(grain, 1);
+    const int count = (last - first + grain - 1) / grain;
+
+    const int n = static_cast<int>(active.load());
+
+    if (count == 1 || n == 0)
+    {
+        for (int b = first; b < last; b += grain)
+            func(b, std::min(b + grain, last));
+        return;
+    }
+
+    Job job;
+    job.func = &func;
+    job.remaining = count;
+
+    // раздаём куски по очередям по кругу; свою очередь поток пула заполняет первой
+    int q = (worker_index >= 0 && worker_index < n) ? worker_index : static_cast<int>(next_queue++ % n);
+
+    for (int b = first; b < last; b += grain, q = (q + 1) % n)
+    {
+        std::lock_guard<std::mutex> lock(queues[q]->m);
+        queues[q]->tasks.push_back(Task{ &job, b, std::min(b + grain, last) });
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        pending += count;
+    }
+    wake.notify_all();
+
+    // помогаем, пока есть что брать, затем ждём куски, выполняющиеся в других потоках
+    while (job.remaining.load() > 0 && TryRunOne(worker_index)) {}
+
+    {
+        std::unique_lock<std::mutex> lock(job.m);
+        job.done.wait(lock, [&job]{ return job.remaining.load() == 0; });
+    }
+
+    if (job.error)
+        std::rethrow_exception(job.error);
+}
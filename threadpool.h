@@ -0,0 +1,79 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//  Общий пул потоков с перехватом задач (work stealing).
+//  Создаётся один раз на hardware_concurrency() потоков (вызывающий поток считается одним из них)
+//  и переиспользуется всеми операциями. Каждый поток берёт задачи с конца своей очереди,
+//  а когда она пуста - с начала чужих.
+class ThreadPool
+{
+public:
+    static ThreadPool& Instance();
+
+    // число потоков, выполняющих ParallelFor, включая вызывающий
+    unsigned Size() const { return static_cast<unsigned>(threads.size()) + 1; }
+
+    // ограничить число потоков сверху (1 - всё в вызывающем потоке, 0 - без ограничения);
+    // для сравнения однопоточного и многопоточного вариантов
+    void SetMaxThreads(unsigned n);
+
+    // func(begin, end) для кусков [first, last) длиной grain; возвращает управление, когда
+    // обработаны все куски. Вызывающий поток тоже выполняет задачи, поэтому вложенные вызовы
+    // не блокируют пул. Первое исключение из func пробрасывается вызывающему.
+    void ParallelFor(int first, int last, int grain, const std::function<void(int, int)>& func);
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator =(const ThreadPool&) = delete;
+
+private:
+    struct Job
+    {
+        const std::function<void(int, int)>* func;
+        std::atomic<int> remaining;
+        std::mutex m;
+        std::condition_variable done;
+        std::exception_ptr error;
+    };
+
+    struct Task
+    {
+        Job* job;
+        int begin;
+        int end;
+    };
+
+    struct Queue
+    {
+        std::mutex m;
+        std::deque<Task> tasks;
+    };
+
+    explicit ThreadPool(unsigned n);
+    ~ThreadPool();
+
+    void WorkerLoop(unsigned self);
+    bool TryRunOne(int self);
+    void Run(const Task& task);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    std::atomic<int> pending{ 0 };
+    std::atomic<unsigned> next_queue{ 0 };
+    std::atomic<unsigned> active;       // сколько очередей (и потоков пула) сейчас в работе
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    bool stop = false;
+};
+
+#endif // THREADPOOL_H
@@ -0,0 +1,101 @@
+#include "tonelut.h"
+
+#include <cmath>
+
+ToneLut::ToneLut() : affine(false), scale{ { 1.0f, 1.0f, 1.0f } }, offset{ { 0.0f, 0.0f, 0.0f } }
+{
+    for (auto& t : tables)
+        for (int v = 0; v < 256; ++v)
+            t[v] = static_cast<uchar>(v);
+}
+
+ToneLut ToneLut::Affine(const std::array<float, 3>& scale, const std::array<float, 3>& offset)
+{
+    // таблица считается тем же кодом, что и пиксели, поэтому оба пути дают одинаковый результат
+    std::array<QRgb, 256> ramp;
+    for (int v = 0; v < 256; ++v)
+        ramp[v] = qRgb(v, v, v);
+
+    ApplyAffine(ramp.data(), ramp.size(), scale, offset);
+
+    ToneLut lut;
+    for (int v = 0; v < 256; ++v)
+    {
+        lut.tables[0][v] = static_cast<uchar>(qRed(ramp[v]));
+        lut.tables[1][v] = static_cast<uchar>(qGreen(ramp[v]));
+        lut.tables[2][v] = static_cast<uchar>(qBlue(ramp[v]));
+    }
+
+    lut.affine = true;
+    lut.scale = scale;
+    lut.offset = offset;
+
+    return lut;
+}
+
+ToneLut ToneLut::Stretch(const std::array<uchar, 3>& min, const std::array<uchar, 3>& max)
+{
+    // (x - min) * 255 / (max - min). Точные значения отстоят от целых хотя бы на 1/255,
+    // поэтому добавка 1e-3 лишь компенсирует погрешность float и не меняет результат усечения
+    std::array<float, 3> scale;
+    std::array<float, 3> offset;
+
+    for (int ch = 0; ch < 3; ++ch)
+    {
+        const int div = max[ch] - min[ch];
+
+        scale[ch] = div != 0 ? 255.0f / div : 1.0f;
+        offset[ch] = div != 0 ? -min[ch] * scale[ch] + 1e-3f : 0.0f;
+    }
+
+    return Affine(scale, offset);
+}
+
+ToneLut ToneLut::Gamma(double c, double d)
+{
+    ToneLut lut;
+
+    for (int v = 0; v < 256; ++v)
+    {
+        const double y = std::round(c * std::pow(v, d));
+        const uchar out = y > 255.0 ? 255 : (y < 0.0 ? 0 : static_cast<uchar>(y));
+
+        for (auto& t : lut.tables)
+            t[v] = out;
+    }
+
+    return lut;
+}
+
+ToneLut ToneLut::then(const ToneLut& next) const
+{
+    if (isIdentity())
+        return next;
+    if (next.isIdentity())
+        return *this;
+
+    ToneLut lut;
+    for (int ch = 0; ch < 3; ++ch)
+        for (int v = 0; v < 256; ++v)
+            lut.tables[ch][v] = next.tables[ch][tables[ch][v]];
+
+    return lut;
+}
+
+bool ToneLut::isIdentity() const
+{
+    for (const auto& t : tables)
+        for (int v = 0; v < 256; ++v)
+            if (t[v] != v)
+                return false;
+
+    return true;
+}
+
+void ToneLut::apply(QRgb* pixels, std::size_t count) const
+{
+    if (affine)
+        ApplyAffine(pixels, count, scale, offset);
+    else
+        ApplyTable(pixels, count, tables);
+}
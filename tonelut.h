@@ -0,0 +1,42 @@
+#ifndef TONELUT_H
+#define TONELUT_H
+
+#include <QRgb>
+
+#include <array>
+#include <cstddef>
+
+#include "pointops.h"
+
+//  Поканальное тоновое преобразование 0..255 -> 0..255, скомпилированное в три таблицы по 256 байт.
+//  Несколько преобразований подряд сворачиваются в одну таблицу до обращения к пикселям.
+class ToneLut
+{
+public:
+    ToneLut();      // тождественное
+
+    // clamp(trunc(x * scale + offset)), каналы R, G, B
+    static ToneLut Affine(const std::array<float, 3>& scale, const std::array<float, 3>& offset);
+    // линейное растяжение [min, max] -> [0, 255]; постоянный канал не меняется
+    static ToneLut Stretch(const std::array<uchar, 3>& min, const std::array<uchar, 3>& max);
+    // clamp(round(c * x^d))
+    static ToneLut Gamma(double c, double d);
+
+    // сначала this, затем next
+    ToneLut then(const ToneLut& next) const;
+
+    bool isIdentity() const;
+    const ChannelTable& operator[](int ch) const { return tables[ch]; }
+
+    void apply(QRgb* pixels, std::size_t count) const;
+
+private:
+    std::array<ChannelTable, 3> tables;
+
+    // одиночное аффинное преобразование применяется без таблиц (ApplyAffine)
+    bool affine;
+    std::array<float, 3> scale;
+    std::array<float, 3> offset;
+};
+
+#endif // TONELUT_H